@@ -0,0 +1,222 @@
+#ifndef CHFILE_H_
+#define CHFILE_H_
+
+#include "Graph.h"
+#include "RankRenumbering.h"
+#include "mapped_file.h"
+#include "constants.h"
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+
+//! A contraction hierarchy with its core in one binary file:
+//!
+//!   header | forward first_out | forward head | forward time | forward energy | backward first_out |
+//!   backward head | backward time | backward energy | rank | core flags | charging station flags
+//!
+//! Every section starts at a multiple of chFileAlignment, so that a mapping of the file can be used
+//! by the query without copying. The vertices are renumbered by rank: the rank section maps the original
+//! IDs to the new ones, all other sections use the new IDs. The forward and backward graphs are the
+//! search graphs of CHIndex, i.e., they only keep the edges given by upwardGraph. The energy profiles
+//! are stored as energyProfileStorage, so a file can only be read by a build with the same encoding.
+//! The header records whether the witnesses of the contraction were energy aware (see CHIndex::keepsTradeOffs).
+//! Numbers are stored in the byte order of the machine that wrote the file; endianCheck detects a mismatch.
+
+const char chFileMagic[8] = { 'C', 'O', 'R', 'E', '_', 'C', 'H', '\0' };
+const unsigned chFileVersion = 5;
+const unsigned chFileAlignment = 64;
+const unsigned chFileEndianCheck = 0x01020304u;
+
+enum chFileSectionID {
+	forwardFirstOutSection,
+	forwardHeadSection,
+	forwardTimeSection,
+	forwardEnergySection,
+	backwardFirstOutSection,
+	backwardHeadSection,
+	backwardTimeSection,
+	backwardEnergySection,
+	rankSection,
+	coreSection,
+	chargingStationSection,
+	chFileSectionNumber
+};
+
+struct chFileSection
+{
+	unsigned long long offset;
+	unsigned long long size;
+};
+
+struct chFileHeader
+{
+	char magic[8];
+	unsigned version;
+	unsigned endianCheck;
+	unsigned vertexNumber;
+	unsigned forwardEdgeNumber;
+	unsigned backwardEdgeNumber;
+	unsigned coreSize;
+	unsigned chargingStationNumber;
+	unsigned energyProfileSize;
+	int maxCapacity;
+	unsigned energyAwareWitnesses;
+	chFileSection section[chFileSectionNumber];
+};
+
+namespace chFileDetail {
+	inline unsigned long long align(unsigned long long offset) {
+		return (offset + chFileAlignment - 1) / chFileAlignment * chFileAlignment;
+	}
+
+	template<class T>
+	void writeSection(std::ofstream& out, chFileHeader& header, chFileSectionID id, const T* data, unsigned long long elements) {
+		unsigned long long position = out.tellp();
+		unsigned long long offset = align(position);
+		static const char padding[chFileAlignment] = {};
+		out.write(padding, offset - position);
+		if (elements != 0)
+			out.write(reinterpret_cast<const char*>(data), elements * sizeof(T));
+		header.section[id].offset = offset;
+		header.section[id].size = elements * sizeof(T);
+	}
+
+	template<class T>
+	void writeSection(std::ofstream& out, chFileHeader& header, chFileSectionID id, const vector<T>& data) {
+		writeSection(out, header, id, data.data(), data.size());
+	}
+}
+
+//! Writes the augmented graph with its order, the size of the uncontracted core, the charging stations and
+//! whether the contraction used energy aware witnesses (ContractionBuilder::hasEnergyAwareWitnesses).
+inline
+void saveCHFile(const string& file_name, const adjacencyGraph& graph, const vector<unsigned>& order, unsigned coreSize, const vector<bool>& chargingStation, bool energyAwareWitnesses) {
+	const unsigned n = graph.vertexNumber();
+	if (order.size() != n || chargingStation.size() != n || coreSize > n)
+		throw std::runtime_error("Can not write \""+file_name+"\" because order, core size and charging stations do not fit the graph.");
+
+	RankRenumbering renumbering(order);
+	adjacencyGraph permuted = renumbering.permuteGraph(graph);
+	adjacencyGraph forward = upwardGraph(permuted, coreSize);
+	adjacencyGraph backward = upwardGraph(adjacencyGraph::reverse(permuted), coreSize);
+
+	vector<unsigned char> core(n), station(n);
+	unsigned stationNumber = 0;
+	for (unsigned i = 0; i < n; i++) {
+		core[i] = i + coreSize >= n;
+		station[renumbering.toInternal(i)] = chargingStation[i];
+		stationNumber += chargingStation[i];
+	}
+
+	chFileHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, chFileMagic, sizeof(header.magic));
+	header.version = chFileVersion;
+	header.endianCheck = chFileEndianCheck;
+	header.vertexNumber = n;
+	header.forwardEdgeNumber = forward.edgeNumber();
+	header.backwardEdgeNumber = backward.edgeNumber();
+	header.coreSize = coreSize;
+	header.chargingStationNumber = stationNumber;
+	header.energyProfileSize = sizeof(energyProfileStorage);
+	header.maxCapacity = maxCapacity;
+	header.energyAwareWitnesses = energyAwareWitnesses;
+
+	std::ofstream out(file_name, std::ios::binary);
+	if (!out)
+		throw std::runtime_error("Can not open \""+file_name+"\" for writing.");
+	out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+	const edgeCostArray<>& forwardWeight = forward.getWeightArray();
+	const edgeCostArray<>& backwardWeight = backward.getWeightArray();
+	chFileDetail::writeSection(out, header, forwardFirstOutSection, forward.getFirstOut());
+	chFileDetail::writeSection(out, header, forwardHeadSection, forward.getHead());
+	chFileDetail::writeSection(out, header, forwardTimeSection, forwardWeight.timeData(), forwardWeight.size());
+	chFileDetail::writeSection(out, header, forwardEnergySection, forwardWeight.energyData(), forwardWeight.size());
+	chFileDetail::writeSection(out, header, backwardFirstOutSection, backward.getFirstOut());
+	chFileDetail::writeSection(out, header, backwardHeadSection, backward.getHead());
+	chFileDetail::writeSection(out, header, backwardTimeSection, backwardWeight.timeData(), backwardWeight.size());
+	chFileDetail::writeSection(out, header, backwardEnergySection, backwardWeight.energyData(), backwardWeight.size());
+	chFileDetail::writeSection(out, header, rankSection, renumbering.getInternalIDs());
+	chFileDetail::writeSection(out, header, coreSection, core);
+	chFileDetail::writeSection(out, header, chargingStationSection, station);
+
+	//now the offsets are known
+	out.seekp(0);
+	out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	if (!out)
+		throw std::runtime_error("Can not write \""+file_name+"\".");
+}
+
+//! A mapped index file. The arrays point directly into the mapping.
+class CHFile {
+
+private:
+	MappedFile file;
+	const chFileHeader* header;
+
+	template<class T>
+	const T* getSection(chFileSectionID id, unsigned long long elements) const {
+		const chFileSection& s = header->section[id];
+		if (s.size != elements * sizeof(T))
+			throw std::runtime_error("Index file has a section of the wrong size.");
+		return reinterpret_cast<const T*>(file.data() + s.offset);
+	}
+
+public:
+	explicit CHFile(const string& file_name) :
+		file(file_name),
+		header(reinterpret_cast<const chFileHeader*>(file.data()))
+	{
+		if (file.size() < sizeof(chFileHeader) || memcmp(header->magic, chFileMagic, sizeof(chFileMagic)) != 0)
+			throw std::runtime_error("\""+file_name+"\" is no contraction hierarchy index file.");
+		if (header->endianCheck != chFileEndianCheck)
+			throw std::runtime_error("\""+file_name+"\" was written on a machine with a different byte order.");
+		if (header->version != chFileVersion)
+			throw std::runtime_error("\""+file_name+"\" has an unsupported version.");
+		if (header->energyProfileSize != sizeof(energyProfileStorage) || header->maxCapacity != maxCapacity)
+			throw std::runtime_error("\""+file_name+"\" was written with a different energy profile encoding.");
+		for (unsigned i = 0; i < chFileSectionNumber; i++) {
+			const chFileSection& s = header->section[i];
+			if (s.offset % chFileAlignment != 0 || s.offset > file.size() || s.size > file.size() - s.offset)
+				throw std::runtime_error("\""+file_name+"\" is truncated or corrupt.");
+		}
+		if (header->coreSize > header->vertexNumber || getForwardFirstOut()[header->vertexNumber] != header->forwardEdgeNumber || getBackwardFirstOut()[header->vertexNumber] != header->backwardEdgeNumber)
+			throw std::runtime_error("\""+file_name+"\" is corrupt.");
+	}
+
+	unsigned vertexNumber() const { return header->vertexNumber; }
+	unsigned forwardEdgeNumber() const { return header->forwardEdgeNumber; }
+	unsigned backwardEdgeNumber() const { return header->backwardEdgeNumber; }
+	unsigned getCoreSize() const { return header->coreSize; }
+	unsigned getChargingStationNumber() const { return header->chargingStationNumber; }
+	bool hasEnergyAwareWitnesses() const { return header->energyAwareWitnesses != 0; }
+
+	const unsigned* getForwardFirstOut() const { return getSection<unsigned>(forwardFirstOutSection, vertexNumber() + 1ull); }
+	const unsigned* getForwardHead() const { return getSection<unsigned>(forwardHeadSection, forwardEdgeNumber()); }
+	const unsigned* getForwardTime() const { return getSection<unsigned>(forwardTimeSection, forwardEdgeNumber()); }
+	const energyProfileStorage* getForwardEnergy() const { return getSection<energyProfileStorage>(forwardEnergySection, forwardEdgeNumber()); }
+	const unsigned* getBackwardFirstOut() const { return getSection<unsigned>(backwardFirstOutSection, vertexNumber() + 1ull); }
+	const unsigned* getBackwardHead() const { return getSection<unsigned>(backwardHeadSection, backwardEdgeNumber()); }
+	const unsigned* getBackwardTime() const { return getSection<unsigned>(backwardTimeSection, backwardEdgeNumber()); }
+	const energyProfileStorage* getBackwardEnergy() const { return getSection<energyProfileStorage>(backwardEnergySection, backwardEdgeNumber()); }
+	const unsigned* getRank() const { return getSection<unsigned>(rankSection, vertexNumber()); }
+	//! Indexed by rank like the graphs.
+	const unsigned char* getCore() const { return getSection<unsigned char>(coreSection, vertexNumber()); }
+	const unsigned char* getChargingStation() const { return getSection<unsigned char>(chargingStationSection, vertexNumber()); }
+
+	adjacencyGraphView getForwardGraph() const { return adjacencyGraphView(getForwardFirstOut(), getForwardHead(), getForwardTime(), getForwardEnergy(), vertexNumber()); }
+	adjacencyGraphView getBackwardGraph() const { return adjacencyGraphView(getBackwardFirstOut(), getBackwardHead(), getBackwardTime(), getBackwardEnergy(), vertexNumber()); }
+
+	//! The order is not stored, it is recovered from the rank.
+	vector<unsigned> getOrder() const {
+		vector<unsigned> order(vertexNumber());
+		const unsigned* rank = getRank();
+		for (unsigned i = 0; i < vertexNumber(); i++)
+			order[rank[i]] = i;
+		return order;
+	}
+};
+
+#endif /* CHFILE_H_ */
@@ -2,37 +2,137 @@
 #define CHQUERY_H_
 
 #include "Graph.h"
-#include "id_queue.h"
+#include "radix_queue.h"
 #include "constants.h"
+#include "parallel_for.h"
+#include "CHFile.h"
+#include "RankRenumbering.h"
+#include "instrumentation.h"
+#include <memory>
 
-class CHQuery {
+//! The immutable part of a contraction hierarchy query. It is only read by queries,
+//! so one index can be shared by the CHQuery objects of any number of threads.
+//! The arrays are either owned by the index or point into a mapped CHFile.
+//! The vertices are renumbered by rank (see RankRenumbering), so an upward edge leads to a higher ID
+//! and the uncontracted core used by CoreCHQuery is formed by the last coreSize IDs.
+//! rank translates the external IDs of the queries to the IDs of the index.
+//! Both graphs only hold the edges their search uses (see upwardGraph): the forward graph the upward
+//! edges, the backward graph the reversed edges that come down from a higher ranked node.
+class CHIndex {
 
 private:
-	adjacencyGraph forwardGraph;
-	adjacencyGraph backwardGraph;
-	vector<unsigned> rank;
-	MinIDQueue forwardQueue;
-	MinIDQueue backwardQueue;
+	vector<unsigned> forwardFirstOut;
+	vector<unsigned> forwardHead;
+	edgeCostArray<> forwardWeight;
+	vector<unsigned> backwardFirstOut;
+	vector<unsigned> backwardHead;
+	edgeCostArray<> backwardWeight;
+	vector<unsigned> rankStorage;
+	vector<unsigned char> coreStorage;
+	shared_ptr<const CHFile> file;
+
+	adjacencyGraphView forwardGraph;
+	adjacencyGraphView backwardGraph;
+	const unsigned* rank;
+	const unsigned char* isCore;
+	unsigned coreSize;
+	bool energyAwareWitnesses;
+
+public:
+	//! energyAwareWitnesses tells whether the hierarchy was contracted with ContractionBuilder::setEnergyAwareWitnesses.
+	CHIndex(const adjacencyGraph& graph, const vector<unsigned>& order, unsigned coreSize = 0, bool energyAwareWitnesses = false) :
+		coreStorage(order.size()),
+		coreSize(coreSize),
+		energyAwareWitnesses(energyAwareWitnesses)
+	{
+		assert(coreSize <= order.size());
+		RankRenumbering renumbering(order);
+		adjacencyGraph permuted = renumbering.permuteGraph(graph);
+		adjacencyGraph forward = upwardGraph(permuted, coreSize);
+		adjacencyGraph backward = upwardGraph(adjacencyGraph::reverse(permuted), coreSize);
+		forwardFirstOut = forward.getFirstOut();
+		forwardHead = forward.getHead();
+		forwardWeight = forward.getWeightArray();
+		backwardFirstOut = backward.getFirstOut();
+		backwardHead = backward.getHead();
+		backwardWeight = backward.getWeightArray();
+
+		rankStorage = renumbering.getInternalIDs();
+		for (unsigned i = 0; i < order.size(); i++)
+			coreStorage[i] = i + coreSize >= order.size();
+
+		forwardGraph = adjacencyGraphView(forwardFirstOut.data(), forwardHead.data(), forwardWeight.timeData(), forwardWeight.energyData(), graph.vertexNumber());
+		backwardGraph = adjacencyGraphView(backwardFirstOut.data(), backwardHead.data(), backwardWeight.timeData(), backwardWeight.energyData(), graph.vertexNumber());
+		rank = rankStorage.data();
+		isCore = coreStorage.data();
+	}
+
+	//! Uses the arrays of the file without copying them. The file stays mapped as long as the index exists.
+	explicit CHIndex(shared_ptr<const CHFile> file) :
+		file(file),
+		forwardGraph(file->getForwardGraph()),
+		backwardGraph(file->getBackwardGraph()),
+		rank(file->getRank()),
+		isCore(file->getCore()),
+		coreSize(file->getCoreSize()),
+		energyAwareWitnesses(file->hasEnergyAwareWitnesses())
+	{ }
+
+	CHIndex(const CHIndex&) = delete;
+	CHIndex& operator=(const CHIndex&) = delete;
+
+	const unsigned vertexNumber() const { return forwardGraph.vertexNumber(); }
+	const adjacencyGraphView& getForwardGraph() const { return forwardGraph; }
+	const adjacencyGraphView& getBackwardGraph() const { return backwardGraph; }
+	const unsigned* getRank() const { return rank; }
+	unsigned toInternal(unsigned v) const { assert(v < vertexNumber()); return rank[v]; }
+	const unsigned char* getCore() const { return isCore; }
+	unsigned getCoreSize() const { return coreSize; }
+	bool hasEnergyAwareWitnesses() const { return energyAwareWitnesses; }
+	//! True if the search graphs keep every non-dominated time/energy trade-off between core nodes, i.e., if the
+	//! witnesses were energy aware or nothing was contracted. Time-only witnesses drop slower but cheaper shortcuts.
+	bool keepsTradeOffs() const { return energyAwareWitnesses || coreSize == vertexNumber(); }
+};
+
+//! The reference hierarchy of a metric: the augmented graph in the original IDs and its contraction order.
+//! The files are those of the reference hierarchies in the graph folders, e.g., travel_time_ch/.
+//! Only the travel times are stored, so the edges get no energy.
+inline
+adjacencyGraph loadReferenceCH(const string& folder, vector<unsigned>& order) {
+	vector<unsigned> weight = load_vector<unsigned>(folder + "weight");
+	order = load_vector<unsigned>(folder + "order");
+	return adjacencyGraph(load_vector<unsigned>(folder + "first_out"), load_vector<unsigned>(folder + "head"), weightGnerate(weight, vector<int>(weight.size(), 0)));
+}
+
+//! The mutable state of one query, i.e., what every thread needs on its own.
+class QueryContext {
+
+protected:
+	DijkstraQueue forwardQueue;
+	DijkstraQueue backwardQueue;
 	vector<edgeCost> forwardCost;
 	vector<edgeCost> backwardCost;
 	vector<unsigned> forwardCount;
 	vector<unsigned> backwardCount;
 	unsigned runTime;
 	edgeCost tentativeDistance;
+	unsigned settledNodes;
+	unsigned relaxedEdges;
+	unsigned stalledNodes;
 
 public:
-	CHQuery(const adjacencyGraph& graph, vector<unsigned>& order) :
-		forwardGraph(graph),
-		backwardGraph(adjacencyGraph::reverse(graph)),
-		rank(order.size()),
-		forwardQueue(graph.vertexNumber()),
-		backwardQueue(graph.vertexNumber()),
-		forwardCost(graph.vertexNumber()),
-		backwardCost(graph.vertexNumber()),
-		forwardCount(graph.vertexNumber()),
-		backwardCount(graph.vertexNumber()),
+	explicit QueryContext(unsigned vertexNumber) :
+		forwardQueue(vertexNumber),
+		backwardQueue(vertexNumber),
+		forwardCost(vertexNumber),
+		backwardCost(vertexNumber),
+		forwardCount(vertexNumber),
+		backwardCount(vertexNumber),
 		runTime(0),
-		tentativeDistance({ inf_weight ,{ 0 , maxCapacity , 0 } })
+		tentativeDistance({ inf_weight ,{ 0 , maxCapacity , 0 } }),
+		settledNodes(0),
+		relaxedEdges(0),
+		stalledNodes(0)
 	{
 		for (unsigned i = 0; i < forwardCost.size(); i++) {
 			edgeConsumptionProfile initial = {0 , maxCapacity , 0};
@@ -41,10 +141,6 @@ public:
 			forwardCount[i] = 0;
 			backwardCount[i] = 0;
 		}
-
-		for (unsigned i = 0; i < order.size(); i++) {
-			rank[order[i]] = i;
-		}
 	}
 
 	edgeCost getForwardCost(unsigned i) {
@@ -65,8 +161,99 @@ public:
 		return backwardCost[i];
 	}
 
+	//! Search space of the last query. Stalled nodes are counted as settled but their edges are not relaxed.
+	unsigned getSettledNodes() const { return settledNodes; }
+	unsigned getRelaxedEdges() const { return relaxedEdges; }
+	unsigned getStalledNodes() const { return stalledNodes; }
+};
+
+//! A query context bound to an index. The constructor taking the graph builds its own index,
+//! the one taking a shared index only allocates the per-query state.
+class CHQuery : public QueryContext {
+
+private:
+	shared_ptr<const CHIndex> index;
+	bool stallOnDemand;
+
+public:
+	CHQuery(const adjacencyGraph& graph, vector<unsigned>& order, bool stallOnDemand = true) :
+		QueryContext(graph.vertexNumber()),
+		index(make_shared<CHIndex>(graph, order)),
+		stallOnDemand(stallOnDemand)
+	{ }
+
+	CHQuery(shared_ptr<const CHIndex> index, bool stallOnDemand = true) :
+		QueryContext(index->vertexNumber()),
+		index(index),
+		stallOnDemand(stallOnDemand)
+	{ }
+
+	shared_ptr<const CHIndex> getIndex() const { return index; }
+
+	//! Interleaved bidirectional search that always expands the queue with the smaller minimum.
+	//! A direction is finished once its minimum reaches the tentative distance.
 	edgeCost run(unsigned source, unsigned target) {
+		CORE_CH_SEARCH(ch_query_search);
+		source = index->toInternal(source);
+		target = index->toInternal(target);
 		runTime++;
+		settledNodes = 0;
+		relaxedEdges = 0;
+		stalledNodes = 0;
+		edgeConsumptionProfile initial = { 0 , maxCapacity , 0 };
+		forwardQueue.clear();
+		backwardQueue.clear();
+		tentativeDistance = { inf_weight , initial };
+		forwardCount[source] = runTime;
+		forwardCost[source] = { 0 , initial };
+		backwardCount[target] = runTime;
+		backwardCost[target] = { 0 , initial };
+		if (source == target)
+			return { 0 , initial };
+		forwardQueue.push({source, forwardCost[source]});
+		backwardQueue.push({target, backwardCost[target]});
+
+		for (;;) {
+			bool forwardDone = forwardQueue.empty() || forwardQueue.peek().key.timeCost >= tentativeDistance.timeCost;
+			bool backwardDone = backwardQueue.empty() || backwardQueue.peek().key.timeCost >= tentativeDistance.timeCost;
+			if (forwardDone && backwardDone) break;
+
+			if (backwardDone || (!forwardDone && forwardQueue.peek().key.timeCost <= backwardQueue.peek().key.timeCost)) {
+				unsigned u = forwardQueue.pop().id;
+				settledNodes++;
+				if (stallOnDemand && isForwardStalled(u)) {
+					stalledNodes++;
+					continue;
+				}
+				relaxForward(u);
+			} else {
+				unsigned u = backwardQueue.pop().id;
+				settledNodes++;
+				if (stallOnDemand && isBackwardStalled(u)) {
+					stalledNodes++;
+					continue;
+				}
+				relaxBackward(u);
+			}
+		}
+
+		CORE_CH_COUNT_N(ch_query_search, settled_nodes, settledNodes);
+		CORE_CH_COUNT_N(ch_query_search, relaxed_edges, relaxedEdges);
+		CORE_CH_COUNT_N(ch_query_search, stalled_nodes, stalledNodes);
+		return tentativeDistance;
+	}
+
+	//! The original schedule: the complete forward search followed by the complete backward search, without stalling.
+	//! Kept to compare the search space with run().
+	edgeCost runSequential(unsigned source, unsigned target) {
+		const adjacencyGraphView& forwardGraph = index->getForwardGraph();
+		const adjacencyGraphView& backwardGraph = index->getBackwardGraph();
+		source = index->toInternal(source);
+		target = index->toInternal(target);
+		runTime++;
+		settledNodes = 0;
+		relaxedEdges = 0;
+		stalledNodes = 0;
 		edgeConsumptionProfile initial = { 0 , maxCapacity , 0 };
 		forwardQueue.clear();
 		backwardQueue.clear();
@@ -78,18 +265,22 @@ public:
 		forwardQueue.push({source, 0});
 		backwardQueue.push({target, 0});
 
+		if (source == target)
+			return { 0 , initial };
+
 		while (!forwardQueue.empty()) {
 			unsigned u = forwardQueue.pop().id;
 			if (u == target) break;
 			edgeCost distanceU = getForwardCost(u);
 			if (distanceU.timeCost > tentativeDistance.timeCost) break;
+			settledNodes++;
 			FORALL_OUTGOING_EDGES(forwardGraph, u, e) {
 				unsigned v = forwardGraph.getEdgeHead(e);
-				if (rank[v] <= rank[u]) continue;
+				relaxedEdges++;
 				edgeCost distanceV = getForwardCost(v);
-				if (distanceU.timeCost + forwardGraph.getEdgeWeight(e).timeCost < distanceV.timeCost) {
-					forwardCost[v].timeCost = distanceU.timeCost + forwardGraph.getEdgeWeight(e).timeCost;
-					forwardCost[v].energyCost = edgeConsumptionProfileCombine( distanceU.energyCost , forwardGraph.getEdgeWeight(e).energyCost);
+				if (distanceU.timeCost + forwardGraph.getEdgeTime(e) < distanceV.timeCost) {
+					forwardCost[v].timeCost = distanceU.timeCost + forwardGraph.getEdgeTime(e);
+					forwardCost[v].energyCost = edgeConsumptionProfileCombine( distanceU.energyCost , forwardGraph.getEdgeEnergy(e));
 
 					if (forwardQueue.contains_id(v))
 						forwardQueue.decrease_key({v, forwardCost[v]});
@@ -103,7 +294,7 @@ public:
 //					}
 					if (getForwardCost(v).timeCost + getBackwardCost(v).timeCost < tentativeDistance.timeCost) {
 						tentativeDistance.timeCost = getForwardCost(v).timeCost + getBackwardCost(v).timeCost;
-						tentativeDistance.energyCost = edgeConsumptionProfileCombine(getForwardCost(v).energyCost, getBackwardCost(u).energyCost);
+						tentativeDistance.energyCost = edgeConsumptionProfileCombine(getForwardCost(v).energyCost, getBackwardCost(v).energyCost);
 					}
 				}
 			}
@@ -114,13 +305,14 @@ public:
 			if (u == source) break;
 			edgeCost distanceU = getBackwardCost(u);
 			if (distanceU.timeCost > tentativeDistance.timeCost) break;
+			settledNodes++;
 			FORALL_OUTGOING_EDGES(backwardGraph, u, e) {
 				unsigned v = backwardGraph.getEdgeHead(e);
-				if (rank[v] <= rank[u]) continue;
+				relaxedEdges++;
 				edgeCost distanceV = getBackwardCost(v);
-				if (distanceU.timeCost + backwardGraph.getEdgeWeight(e).timeCost < distanceV.timeCost) {
-					backwardCost[v].timeCost = distanceU.timeCost + backwardGraph.getEdgeWeight(e).timeCost;
-					backwardCost[v].energyCost = edgeConsumptionProfileCombine(distanceU.energyCost, backwardGraph.getEdgeWeight(e).energyCost);
+				if (distanceU.timeCost + backwardGraph.getEdgeTime(e) < distanceV.timeCost) {
+					backwardCost[v].timeCost = distanceU.timeCost + backwardGraph.getEdgeTime(e);
+					backwardCost[v].energyCost = edgeConsumptionProfileCombine(backwardGraph.getEdgeEnergy(e), distanceU.energyCost);
 					if (backwardQueue.contains_id(v))
 						backwardQueue.decrease_key({v, backwardCost[v]});
 					else
@@ -135,6 +327,94 @@ public:
 
 		return tentativeDistance;
 	}
+
+private:
+	//! Stall-on-demand: u is not expanded if a higher ranked node w reaches u with a shorter path over a downward edge.
+	//! Then the label of u is not a shortest distance, so nothing can be gained from its edges.
+	//! The graph of the opposite direction holds exactly the edges between u and the higher ranked nodes.
+	bool isForwardStalled(unsigned u) {
+		CORE_CH_PHASE(ch_query_search, stall_phase);
+		const adjacencyGraphView& backwardGraph = index->getBackwardGraph();
+		unsigned distanceU = forwardCost[u].timeCost;
+		FORALL_OUTGOING_EDGES(backwardGraph, u, e) {
+			unsigned w = backwardGraph.getEdgeHead(e);
+			if (getForwardCost(w).timeCost + backwardGraph.getEdgeTime(e) < distanceU) return true;
+		}
+		return false;
+	}
+
+	bool isBackwardStalled(unsigned u) {
+		CORE_CH_PHASE(ch_query_search, stall_phase);
+		const adjacencyGraphView& forwardGraph = index->getForwardGraph();
+		unsigned distanceU = backwardCost[u].timeCost;
+		FORALL_OUTGOING_EDGES(forwardGraph, u, e) {
+			unsigned w = forwardGraph.getEdgeHead(e);
+			if (getBackwardCost(w).timeCost + forwardGraph.getEdgeTime(e) < distanceU) return true;
+		}
+		return false;
+	}
+
+	void relaxForward(unsigned u) {
+		const adjacencyGraphView& forwardGraph = index->getForwardGraph();
+		edgeCost distanceU = getForwardCost(u);
+		FORALL_OUTGOING_EDGES(forwardGraph, u, e) {
+			unsigned v = forwardGraph.getEdgeHead(e);
+			relaxedEdges++;
+			edgeCost distanceV = getForwardCost(v);
+			if (distanceU.timeCost + forwardGraph.getEdgeTime(e) < distanceV.timeCost) {
+				forwardCost[v].timeCost = distanceU.timeCost + forwardGraph.getEdgeTime(e);
+				forwardCost[v].energyCost = edgeConsumptionProfileCombine(distanceU.energyCost, forwardGraph.getEdgeEnergy(e));
+				if (forwardQueue.contains_id(v)) {
+					forwardQueue.decrease_key({v, forwardCost[v]});
+					CORE_CH_COUNT(ch_query_search, decrease_keys);
+				}
+				else
+					forwardQueue.push({v, forwardCost[v]});
+				if (forwardCost[v].timeCost + getBackwardCost(v).timeCost < tentativeDistance.timeCost) {
+					tentativeDistance.timeCost = forwardCost[v].timeCost + backwardCost[v].timeCost;
+					tentativeDistance.energyCost = edgeConsumptionProfileCombine(forwardCost[v].energyCost, backwardCost[v].energyCost);
+				}
+			}
+		}
+	}
+
+	void relaxBackward(unsigned u) {
+		const adjacencyGraphView& backwardGraph = index->getBackwardGraph();
+		edgeCost distanceU = getBackwardCost(u);
+		FORALL_OUTGOING_EDGES(backwardGraph, u, e) {
+			unsigned v = backwardGraph.getEdgeHead(e);
+			relaxedEdges++;
+			edgeCost distanceV = getBackwardCost(v);
+			if (distanceU.timeCost + backwardGraph.getEdgeTime(e) < distanceV.timeCost) {
+				backwardCost[v].timeCost = distanceU.timeCost + backwardGraph.getEdgeTime(e);
+				backwardCost[v].energyCost = edgeConsumptionProfileCombine(backwardGraph.getEdgeEnergy(e), distanceU.energyCost);
+				if (backwardQueue.contains_id(v)) {
+					backwardQueue.decrease_key({v, backwardCost[v]});
+					CORE_CH_COUNT(ch_query_search, decrease_keys);
+				}
+				else
+					backwardQueue.push({v, backwardCost[v]});
+				if (getForwardCost(v).timeCost + backwardCost[v].timeCost < tentativeDistance.timeCost) {
+					tentativeDistance.timeCost = forwardCost[v].timeCost + backwardCost[v].timeCost;
+					tentativeDistance.energyCost = edgeConsumptionProfileCombine(forwardCost[v].energyCost, backwardCost[v].energyCost);
+				}
+			}
+		}
+	}
 };
 
+//! Answers the queries (sources[i], targets[i]) with threadNumber threads that share one index.
+//! Every thread gets its own CHQuery, so the graph is kept in memory only once.
+inline
+vector<edgeCost> runQueries(shared_ptr<const CHIndex> index, const vector<unsigned>& sources, const vector<unsigned>& targets, unsigned threadNumber = 0) {
+	assert(sources.size() == targets.size());
+	threadNumber = get_thread_count(threadNumber);
+	vector<CHQuery> queries(threadNumber, CHQuery(index));
+	vector<edgeCost> result(sources.size());
+	parallel_for(0, sources.size(), threadNumber, [&](unsigned i, unsigned t) {
+		result[i] = queries[t].run(sources[i], targets[i]);
+	});
+	return result;
+}
+
 #endif /* CHQUERY_H_ */
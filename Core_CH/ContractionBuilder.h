@@ -3,39 +3,78 @@
 
 #include "Graph.h"
 #include "id_queue.h"
+#include "radix_queue.h"
 #include "uni_id_queue.h"
 #include "constants.h"
 #include "vector_io.h"
 #include "timer.h"
+#include "parallel_for.h"
+#include "instrumentation.h"
+#include "ContractionTelemetry.h"
 
 
+//! Witnesses are shortest paths by time, so the searches only read the time array of the graph
+//! and leave the energy profile of their labels untouched. If the search is energy aware, the labels
+//! also combine the profiles along the fastest paths, among paths of equal time the dominating one,
+//! so that a witness can be compared with a shortcut in all criteria (see edgeCostDominates).
 class WitnessSearch {
 private:
 	overheadGraph* graph;
-	MinIDQueue Q;
+	DijkstraQueue Q;
 	vector<edgeCost> distance;
 	vector<unsigned> count;
+	vector<unsigned> hops;
+	vector<unsigned> targetMark;
 	unsigned run;
-	unsigned source;
-	unsigned target;
+	const vector<bool>* excluded;
+	unsigned settledLimit;
+	unsigned hopLimit;
+	unsigned settledNodes;
+	unsigned long long totalSettledNodes;
+	unsigned long long searchCycles;
+	bool energyAware;
 
 public:
-	WitnessSearch(overheadGraph* graph) :
+	//! settledLimit and hopLimit bound the one-to-many search of findWitnesses, invalid_id means no limit.
+	//! A search stopped by a limit can only miss witnesses, so it adds too many shortcuts but never too few.
+	WitnessSearch(overheadGraph* graph, unsigned settledLimit = invalid_id, unsigned hopLimit = invalid_id) :
 		graph(graph),
 		Q(graph->vertexNumber()),
 		distance(graph->vertexNumber()),
 		count(graph->vertexNumber()),
+		hops(graph->vertexNumber()),
+		targetMark(graph->vertexNumber()),
 		run(0),
-		source(-1),
-		target(-1)
+		excluded(NULL),
+		settledLimit(settledLimit),
+		hopLimit(hopLimit),
+		settledNodes(0),
+		totalSettledNodes(0),
+		searchCycles(0),
+		energyAware(false)
 	{
 		for (unsigned i = 0; i < distance.size(); i++) {
 			edgeConsumptionProfile initial = { 0,maxCapacity,0 };
 			distance[i] = { inf_weight , initial };
 			count[i] = 0;
+			targetMark[i] = 0;
 		}
 	}
 
+	void setLimits(unsigned settledLimit, unsigned hopLimit) {
+		this->settledLimit = settledLimit;
+		this->hopLimit = hopLimit;
+	}
+
+	void setEnergyAware(bool energyAware) { this->energyAware = energyAware; }
+	bool isEnergyAware() const { return energyAware; }
+
+	//! Number of nodes settled by the last call of findWitnesses.
+	unsigned getSettledNodes() const { return settledNodes; }
+	//! Settled nodes and get_cycle_count() time of all calls of findWitnesses so far.
+	unsigned long long getTotalSettledNodes() const { return totalSettledNodes; }
+	unsigned long long getSearchCycles() const { return searchCycles; }
+
 	edgeCost getDistance(unsigned i) {
 		if (run != count[i]) {
 			count[i] = run;
@@ -45,80 +84,107 @@ public:
 		return distance[i];
 	}
 
-	bool isNecessary(unsigned from, unsigned to, unsigned via, unsigned weight) {
-	    
-	    /*
-
-	    bool necessarity = true;
-	    
-	    if(from == to)
-	    {
-		return false;				//rings exist
-	    }
-	    else
-	    {
-		unsigned u = from;
-		FORALL_OUTGOING_EDGES((*graph), u, e) 
-		{
-		    if (!graph->isValidEdge(e)) 
-			continue;
-		    unsigned v = graph->getEdgeHead(e);
-		    if(v== target)
-		    {
-			necessarity = graph->getEdgeWeight(e).timeCost>weight;
-			break;
-		    }
-		}
-		return necessarity;
-	    }
-
-	
-	     */	
-	
-		/* 
-		 * for normal witness search
-	 */	
-		if (from != source) {
-			run++;
-			Q.clear();
-			count[from] = run;
-			edgeConsumptionProfile initial = { 0,maxCapacity,0 };
+	//! Nodes marked in excluded are treated like the via node, i.e., no witness may pass through them.
+	//! Used by the parallel contraction where all nodes of a round are removed at once.
+	void setExcluded(const vector<bool>* excluded) {
+		this->excluded = excluded;
+	}
 
-			distance[from] = { 0, initial };
-			Q.push({ from, 0 });
+	//! Runs one search from "from" that avoids via and stops once all targets are settled or maxWeight is exceeded.
+	//! Afterwards getDistance(w) is an upper bound of the witness distance to every target w.
+	void findWitnesses(unsigned from, unsigned via, const vector<unsigned>& targets, unsigned maxWeight) {
+		CORE_CH_SEARCH(witness_search);
+		unsigned long long beginCycles = get_cycle_count();
+		run++;
+		Q.clear();
+		settledNodes = 0;
+
+		unsigned targetsLeft = 0;
+		for (unsigned i = 0; i < targets.size(); i++) {
+			if (targetMark[targets[i]] != run) {
+				targetMark[targets[i]] = run;
+				targetsLeft++;
+			}
 		}
 
-		source = from;
-		target = to;
+		count[from] = run;
+		edgeConsumptionProfile initial = { 0,maxCapacity,0 };
+		distance[from] = { 0, initial };
+		hops[from] = 0;
+		Q.push({ from, distance[from] });
 
-		while (!Q.empty()) {
+		while (!Q.empty() && targetsLeft > 0) {
+			if (Q.peek().key.timeCost > maxWeight) break;
 			unsigned u = Q.pop().id;
-			if (u == target) break;
+			if (targetMark[u] == run) {
+				targetMark[u] = 0;
+				targetsLeft--;
+			}
 			if (u == via) continue;
-			edgeCost distanceU = getDistance(u);
-			if (distanceU.timeCost > weight) break;
+			if (excluded != NULL && (*excluded)[u]) continue;
+			if (++settledNodes > settledLimit) break;
+			if (hops[u] >= hopLimit) continue;
+			edgeCost distanceU = distance[u];
 			FORALL_OUTGOING_EDGES((*graph), u, e) {
 				if (!graph->isValidEdge(e)) continue;
+				CORE_CH_COUNT(witness_search, relaxed_edges);
 				unsigned v = graph->getEdgeHead(e);
 				edgeCost distanceV = getDistance(v);
-				if (distanceU.timeCost + graph->getEdgeWeight(e).timeCost < distanceV.timeCost) 
+				if (distanceU.timeCost + graph->getEdgeTime(e) < distanceV.timeCost) 
 				{
-					distance[v].timeCost = distanceU.timeCost + graph->getEdgeWeight(e).timeCost;
-					distance[v].energyCost = edgeConsumptionProfileCombine(distanceU.energyCost , graph->getEdgeWeight(e).energyCost);
-					if (Q.contains_id(v))
+					distance[v].timeCost = distanceU.timeCost + graph->getEdgeTime(e);
+					if (energyAware)
+						distance[v].energyCost = edgeConsumptionProfileCombine(distanceU.energyCost, graph->getEdgeEnergy(e));
+					hops[v] = hops[u] + 1;
+					if (Q.contains_id(v)) {
 						Q.decrease_key({ v, distance[v] });
+						CORE_CH_COUNT(witness_search, decrease_keys);
+					}
 					else
 						Q.push({ v, distance[v] });
 				}
+				else if (energyAware && distanceU.timeCost + graph->getEdgeTime(e) == distanceV.timeCost && Q.contains_id(v))
+				{
+					edgeCost tie = { distanceV.timeCost, edgeConsumptionProfileCombine(distanceU.energyCost, graph->getEdgeEnergy(e)) };
+					if (edgeCostDominates(tie, distanceV)) {
+						distance[v].energyCost = tie.energyCost;
+						hops[v] = hops[u] + 1;
+					}
+				}
 			}
 		}
-
-		return getDistance(target).timeCost > weight;
-
-		
+		CORE_CH_COUNT_N(witness_search, settled_nodes, settledNodes);
+		totalSettledNodes += settledNodes;
+		searchCycles += get_cycle_count() - beginCycles;
 	}
+};
 
+struct shortcut
+{
+	unsigned from;
+	unsigned to;
+	edgeCost weight;
+	unsigned originalEdges;
+};
 
+//! How the witness searches decided on the shortcut candidates of the contracted nodes.
+//! A candidate is added for time if no witness is as fast, and for energy if the fastest witness is as fast
+//! but does not dominate the profile of the shortcut; only energy aware searches add the latter.
+struct witnessStatistics
+{
+	unsigned long long addedForTime;
+	unsigned long long addedForEnergy;
+	unsigned long long avoided;
+	//! Nodes settled by the witness searches that made the decisions.
+	unsigned long long settledNodes;
+
+	witnessStatistics& operator+=(const witnessStatistics& other) {
+		addedForTime += other.addedForTime;
+		addedForEnergy += other.addedForEnergy;
+		avoided += other.avoided;
+		settledNodes += other.settledNodes;
+		return *this;
+	}
 };
 
 class ContractionBuilder {
@@ -142,6 +208,16 @@ private:
 	unsigned edgesInCore;
 	//	easyWitnessSearch EasyWitnessSearch;
 
+	witnessStatistics statistics;
+	ContractionTelemetry telemetry;
+
+	//the shortcuts found by the last getKey(v), valid as long as graphVersion did not change
+	vector<shortcut> cachedShortcuts;
+	witnessStatistics cachedStatistics;
+	unsigned cachedNode;
+	unsigned cachedVersion;
+	unsigned graphVersion;
+
 public:
 	ContractionBuilder(adjacencyGraph& graph , const vector<bool> chargingStation) :
 	//overhead-value: 10 for simpleWitnessSearch, 1 for normal witnessSearch
@@ -154,44 +230,68 @@ public:
 		witnessSearch(&(this->forwardSearchGraph)),
 		contractedNodeNumber(0),
 		shortcutNumber(0),
-		edgesInCore(0)
+		edgesInCore(0),
+		statistics({ 0 , 0 , 0 , 0 }),
+		cachedNode(-1),
+		cachedVersion(0),
+		graphVersion(0)
 		
 		//		EasyWitnessSearch(&(this->forwardSearchGraph))
 	{
 		for (unsigned i = 0; i < level.size(); i++) 
 			level[i] = 0;
-		vector<unsigned> tempNode = load_vector<unsigned>("../../graph/karlsruhe/first_out");
-		//vector<unsigned> tempNode={0,3,6,9,12,15,16,17,17,17};
-		totalNodes = tempNode.size() -1;
-		vector<unsigned> tempEdge = load_vector<unsigned>("../../graph/karlsruhe/head");
-		//vector<unsigned> tempEdge =  {3,5,8,0,2,7,1,4,7,0,5,6,2,6,7,6,4};
-		edgesInCore = tempEdge.size();
-		cout<<"totalNodes:				 "<<totalNodes<<endl;
+		totalNodes = graph.vertexNumber();
+		edgesInCore = graph.edgeNumber();
 	}
 	
 	vector<unsigned> getOrder() { return order; }
+	//! The last getCoreSize() nodes of the order are the uncontracted core.
+	unsigned getCoreSize() { return graph.vertexNumber() - contractedNodeNumber; }
 	adjacencyGraph getAugmentedGraph() { return graph.toNonoverheadGraph(); }
 
+	//! Limits of the witness search, invalid_id means no limit. Tight limits speed up the contraction of dense nodes at the cost of more shortcuts.
+	void setWitnessLimits(unsigned settledLimit, unsigned hopLimit) { witnessSearch.setLimits(settledLimit, hopLimit); }
+
+	//! With energy aware witnesses a shortcut is only left out if a witness dominates it in time and energy,
+	//! and a shortcut is kept next to a parallel edge that is faster but does not dominate it.
+	//! The hierarchy then keeps the trade-offs the Pareto searches need, at the cost of more shortcuts.
+	void setEnergyAwareWitnesses(bool energyAware) { witnessSearch.setEnergyAware(energyAware); }
+	bool hasEnergyAwareWitnesses() const { return witnessSearch.isEnergyAware(); }
+
+	//! Shortcuts added so far, including those that replaced an existing edge.
+	unsigned getShortcutNumber() const { return shortcutNumber; }
+	//! Edges between uncontracted nodes, i.e., the edges of the core once the contraction stopped.
+	unsigned getEdgesInCore() const { return edgesInCore; }
+
+	//! Progress and phase times of the last run. Set its summary interval and stream before the run,
+	//! e.g., setSummary(0, NULL) for a silent contraction, and write its JSON report afterwards.
+	ContractionTelemetry& getTelemetry() { return telemetry; }
+
+	//! The decisions on the shortcuts of all contracted nodes so far.
+	witnessStatistics getWitnessStatistics() const { return statistics; }
+
+	//! The shortcuts found for the key are kept, so that contract() can reuse them if the graph did not change in between.
 	unsigned getKey(unsigned v) {
-		unsigned added = 0;
-		unsigned addedOriginal = 0;
+		unsigned key = getKey(v, witnessSearch, cachedShortcuts, cachedStatistics);
+		cachedNode = v;
+		cachedVersion = graphVersion;
+		return key;
+	}
 
-		FORALL_OUTGOING_EDGES(backwardSearchGraph, v, e) {
-			if (!backwardSearchGraph.isValidEdge(e)) continue;
-			unsigned u = backwardSearchGraph.getEdgeHead(e);
-			FORALL_OUTGOING_EDGES(forwardSearchGraph, v, f) {
-				if (!forwardSearchGraph.isValidEdge(f)) continue;
-				unsigned w = forwardSearchGraph.getEdgeHead(f);
-				edgeCost shortcutWeight;
-				shortcutWeight.timeCost = backwardSearchGraph.getEdgeWeight(e).timeCost + forwardSearchGraph.getEdgeWeight(f).timeCost;
-				shortcutWeight.energyCost = edgeConsumptionProfileCombine(backwardSearchGraph.getEdgeWeight(e).energyCost, forwardSearchGraph.getEdgeWeight(f).energyCost);
-				if (witnessSearch.isNecessary(u, w, v, shortcutWeight.timeCost)) {
-//				if (EasyWitnessSearch.fasterShortcut(u, w, v, shortcutWeight)) {
-					added++;
-					addedOriginal += backwardSearchGraph.getOriginalEdges(e) + forwardSearchGraph.getOriginalEdges(f);
-				}
-			}
-		}
+	unsigned getKey(unsigned v, WitnessSearch& witnessSearch) {
+		vector<shortcut> shortcuts;
+		witnessStatistics decisions;
+		return getKey(v, witnessSearch, shortcuts, decisions);
+	}
+
+	unsigned getKey(unsigned v, WitnessSearch& witnessSearch, vector<shortcut>& shortcuts, witnessStatistics& decisions) {
+		shortcuts.clear();
+		findShortcuts(v, witnessSearch, shortcuts, decisions);
+
+		unsigned added = shortcuts.size();
+		unsigned addedOriginal = 0;
+		for (unsigned i = 0; i < shortcuts.size(); i++)
+			addedOriginal += shortcuts[i].originalEdges;
 
 		unsigned deleted = forwardSearchGraph.outgoingEdgeNumber(v) + backwardSearchGraph.outgoingEdgeNumber(v);
 		unsigned deletedOriginal = forwardSearchGraph.origionalOutgoingEdgeNumber(v) + backwardSearchGraph.origionalOutgoingEdgeNumber(v);
@@ -200,9 +300,9 @@ public:
 	}
 
 	void run(unsigned nodeInCore) {
-	    long long beginTime = get_micro_time();
 	    coreSize = nodeInCore;
 	    Q.clear();
+	    telemetry.begin(graph.vertexNumber() - contractedNodeNumber, edgesInCore, witnessSearch.getSearchCycles(), witnessSearch.getTotalSettledNodes());
 		
 		for (unsigned i = 0; i < graph.vertexNumber(); i++) {
 		    if(chargingStation[i])
@@ -220,81 +320,305 @@ public:
 		    UniIDKeyPair temp =Q.pop();		    
 		    if(contractedNodeNumber + nodeInCore < graph.vertexNumber())
 		    {
+			//lazy update: the key may have become worse since it was computed
+			if(!chargingStation[temp.id] && !Q.empty())
+			{
+			    unsigned key = getKey(temp.id);
+			    if(key > Q.peek().key)
+			    {
+				Q.push({temp.id, key});
+				continue;
+			    }
+			}
+			vector<unsigned> neighbors = getNeighbors(temp.id);
 			order.push_back(temp.id);
-			contract(temp.id);
+			witnessStatistics decisions = contract(temp.id);
 			contractedNodeNumber++;
-//			if(contractedNodeNumber%10000 == 0)
-				{
-				    long long endTime = get_micro_time();
-				    cout<<"ID: "<<temp.id<<"         key: "<<temp.key<<endl;
-				    cout <<"Node "<<temp.id<< " is being contracted "  << endl;
-				    cout<<"contractedNodeNumber	:		"<< contractedNodeNumber <<endl;
-				    cout<<"uncontractedNodeNumber:			"<<totalNodes - contractedNodeNumber<<endl;
-				    cout<<"shortcutNumber:				"<<shortcutNumber<<endl;
-				    cout<<"edgesInCore: "<<edgesInCore<<endl;
-				    cout<<"timeCost till now: "<<endTime - beginTime<<endl;
-				}
+			updateNeighbors(temp.id, neighbors);
+			telemetry.bookSequential(witnessSearch.getSearchCycles(), witnessSearch.getTotalSettledNodes());
+			telemetry.record({ temp.id, 0, (unsigned)neighbors.size(), (unsigned)(decisions.addedForTime + decisions.addedForEnergy),
+				(unsigned)decisions.settledNodes, totalNodes - contractedNodeNumber, edgesInCore });
 		    }
 		    else
 		    {
-			cout <<"Node "<<temp.id<< " will not be contracted "  << endl;
 			order.push_back(temp.id);
 		    }
-//		    cout<<"total contracted NodeNumber:		"<<contractedNodeNumber<<endl;
 		}
+		telemetry.bookSequential(witnessSearch.getSearchCycles(), witnessSearch.getTotalSettledNodes());
+		telemetry.finish();
+		if (telemetry.getSummaryStream() != NULL)
+			printWitnessStatistics(*telemetry.getSummaryStream());
 	}
 
-	void contract(unsigned v) {
-
-		vector<unsigned> forwardNeighbors;
-		vector<unsigned> backwardNeighbors;
+	void printWitnessStatistics(ostream& out = cout) {
+		out<<"shortcuts added for time:		"<<statistics.addedForTime<<endl;
+		out<<"shortcuts added for energy:		"<<statistics.addedForEnergy<<endl;
+		out<<"shortcuts avoided by witnesses:		"<<statistics.avoided<<endl;
+	}
 
+	//! Returns the remaining in- and out-neighbors of v, each only once.
+	vector<unsigned> getNeighbors(unsigned v) {
+		vector<unsigned> neighbors;
 		FORALL_OUTGOING_EDGES(forwardSearchGraph, v, e) {
 			if (!forwardSearchGraph.isValidEdge(e)) continue;
-			forwardNeighbors.push_back(forwardSearchGraph.getEdgeHead(e));
+			neighbors.push_back(forwardSearchGraph.getEdgeHead(e));
 		}
+		FORALL_OUTGOING_EDGES(backwardSearchGraph, v, e) {
+			if (!backwardSearchGraph.isValidEdge(e)) continue;
+			neighbors.push_back(backwardSearchGraph.getEdgeHead(e));
+		}
+		sort(neighbors.begin(), neighbors.end());
+		neighbors.erase(unique(neighbors.begin(), neighbors.end()), neighbors.end());
+		neighbors.erase(remove(neighbors.begin(), neighbors.end(), v), neighbors.end());
+		return neighbors;
+	}
+
+	//! After contracting v only the keys of its neighbors can change, so only they are recomputed.
+	void updateNeighbors(unsigned v, const vector<unsigned>& neighbors) {
+		for (unsigned i = 0; i < neighbors.size(); i++) {
+			unsigned u = neighbors[i];
+			level[u] = max(level[u], level[v] + 1);
+			if (chargingStation[u] || !Q.contains_id(u)) continue;
+			unsigned key = getKey(u);
+			if (!Q.decrease_key({ u, key }))
+				Q.increase_key({ u, key });
+		}
+	}
+
+	void runParallel(unsigned nodeInCore, unsigned threadNumber = 0) {
+		coreSize = nodeInCore;
+		threadNumber = get_thread_count(threadNumber);
+		const unsigned n = graph.vertexNumber();
+		telemetry.begin(n - contractedNodeNumber, edgesInCore);
+
+		vector<WitnessSearch> searches(threadNumber, witnessSearch);
+		unsigned long long bookedSettled = witnessSearch.getTotalSettledNodes() * threadNumber;
+		auto bookWitnessSettled = [&]() {
+			unsigned long long settled = 0;
+			for (unsigned t = 0; t < searches.size(); t++)
+				settled += searches[t].getTotalSettledNodes();
+			telemetry.addWitnessSettled(settled - bookedSettled);
+			bookedSettled = settled;
+		};
+
+		vector<unsigned> key(n);
+		unsigned long long sectionBegin = get_cycle_count();
+		parallel_for(0, n, threadNumber, [&](unsigned i, unsigned t) {
+			key[i] = chargingStation[i] ? inf_weight : getKey(i, searches[t]);
+		});
+		telemetry.addCycles(keyPhase, get_cycle_count() - sectionBegin);
+		bookWitnessSettled();
+
+		vector<bool> contracted(n, false);
+		vector<bool> contracting(n, false);
+		vector<unsigned> remaining(n);
+		for (unsigned i = 0; i < n; i++)
+			remaining[i] = i;
+
+		unsigned round = 0;
+		while (remaining.size() > nodeInCore) {
+			//charging stations are only contracted once every other node is gone, as in run()
+			sectionBegin = get_cycle_count();
+			bool stationsOnly = true;
+			for (unsigned i = 0; i < remaining.size() && stationsOnly; i++)
+				stationsOnly = chargingStation[remaining[i]];
+
+			vector<char> isCandidate(remaining.size());
+			parallel_for(0, remaining.size(), threadNumber, [&](unsigned i, unsigned) {
+				unsigned v = remaining[i];
+				isCandidate[i] = (stationsOnly || !chargingStation[v]) && isLocalMinimum(v, key);
+			});
+
+			vector<unsigned> independent;
+			for (unsigned i = 0; i < remaining.size(); i++)
+				if (isCandidate[i])
+					independent.push_back(remaining[i]);
+
+			//do not contract into the core
+			if (independent.size() > remaining.size() - nodeInCore) {
+				sort(independent.begin(), independent.end(), [&](unsigned a, unsigned b) {
+					return key[a] < key[b] || (key[a] == key[b] && a < b);
+				});
+				independent.resize(remaining.size() - nodeInCore);
+				sort(independent.begin(), independent.end());
+			}
+
+			for (unsigned i = 0; i < independent.size(); i++)
+				contracting[independent[i]] = true;
+			for (unsigned t = 0; t < searches.size(); t++)
+				searches[t].setExcluded(&contracting);
+			telemetry.addCycles(keyPhase, get_cycle_count() - sectionBegin);
+
+			sectionBegin = get_cycle_count();
+			vector<vector<shortcut>> shortcuts(independent.size());
+			vector<witnessStatistics> decisions(independent.size());
+			parallel_for(0, independent.size(), threadNumber, [&](unsigned i, unsigned t) {
+				findShortcuts(independent[i], searches[t], shortcuts[i], decisions[i]);
+			}, 1);
+			telemetry.addCycles(witnessPhase, get_cycle_count() - sectionBegin);
+
+			vector<unsigned> affected;
+			for (unsigned i = 0; i < independent.size(); i++) {
+				unsigned v = independent[i];
+				vector<unsigned> neighbors = getNeighbors(v);
+				order.push_back(v);
+				applyContraction(v, shortcuts[i]);
+				statistics += decisions[i];
+				contracting[v] = false;
+				contracted[v] = true;
+				contractedNodeNumber++;
+				for (unsigned j = 0; j < neighbors.size(); j++) {
+					level[neighbors[j]] = max(level[neighbors[j]], level[v] + 1);
+					affected.push_back(neighbors[j]);
+				}
+				telemetry.record({ v, round + 1, (unsigned)neighbors.size(), (unsigned)shortcuts[i].size(),
+					(unsigned)decisions[i].settledNodes, n - contractedNodeNumber, edgesInCore });
+			}
+
+			for (unsigned t = 0; t < searches.size(); t++)
+				searches[t].setExcluded(NULL);
+
+			//only the neighbors of contracted nodes get new keys
+			sectionBegin = get_cycle_count();
+			sort(affected.begin(), affected.end());
+			affected.erase(unique(affected.begin(), affected.end()), affected.end());
+			parallel_for(0, affected.size(), threadNumber, [&](unsigned i, unsigned t) {
+				unsigned u = affected[i];
+				if (!chargingStation[u])
+					key[u] = getKey(u, searches[t]);
+			}, 16);
 
+			remaining.erase(remove_if(remaining.begin(), remaining.end(), [&](unsigned v) { return contracted[v]; }), remaining.end());
+			telemetry.addCycles(keyPhase, get_cycle_count() - sectionBegin);
+			bookWitnessSettled();
+
+			round++;
+		}
+
+
+		//the core is appended in key order, as the queue in run() would return it
+		sort(remaining.begin(), remaining.end(), [&](unsigned a, unsigned b) {
+			return key[a] < key[b] || (key[a] == key[b] && a < b);
+		});
+		for (unsigned i = 0; i < remaining.size(); i++)
+			order.push_back(remaining[i]);
+		telemetry.finish();
+		if (telemetry.getSummaryStream() != NULL)
+			printWitnessStatistics(*telemetry.getSummaryStream());
+	}
+
+	//! A node may be contracted in the current round if its key is smaller than the key of every remaining neighbor.
+	//! Ties are broken by ID, so the selected nodes form an independent set.
+	bool isLocalMinimum(unsigned v, const vector<unsigned>& key) {
+		FORALL_OUTGOING_EDGES(forwardSearchGraph, v, e) {
+			if (!forwardSearchGraph.isValidEdge(e)) continue;
+			unsigned u = forwardSearchGraph.getEdgeHead(e);
+			if (u != v && (key[u] < key[v] || (key[u] == key[v] && u < v))) return false;
+		}
 		FORALL_OUTGOING_EDGES(backwardSearchGraph, v, e) {
 			if (!backwardSearchGraph.isValidEdge(e)) continue;
-			backwardNeighbors.push_back(backwardSearchGraph.getEdgeHead(e));
+			unsigned u = backwardSearchGraph.getEdgeHead(e);
+			if (u != v && (key[u] < key[v] || (key[u] == key[v] && u < v))) return false;
 		}
+		return true;
+	}
+
+	//! Returns the decisions on the shortcuts of v.
+	witnessStatistics contract(unsigned v) {
+		if (cachedNode == v && cachedVersion == graphVersion) {
+			statistics += cachedStatistics;
+			applyContraction(v, cachedShortcuts);
+			return cachedStatistics;
+		}
+		vector<shortcut> shortcuts;
+		witnessStatistics decisions;
+		findShortcuts(v, witnessSearch, shortcuts, decisions);
+		statistics += decisions;
+		applyContraction(v, shortcuts);
+		return decisions;
+	}
+
+	//! Collects the shortcuts needed to contract v without modifying any graph, so it can run concurrently.
+	//! There is one witness search per in-neighbor u towards all out-neighbors w.
+	void findShortcuts(unsigned v, WitnessSearch& witnessSearch, vector<shortcut>& shortcuts, witnessStatistics& decisions) {
+		decisions = { 0 , 0 , 0 , 0 };
+		vector<unsigned> targets;
+		unsigned maxOutWeight = 0;
+		FORALL_OUTGOING_EDGES(forwardSearchGraph, v, f) {
+			if (!forwardSearchGraph.isValidEdge(f)) continue;
+			targets.push_back(forwardSearchGraph.getEdgeHead(f));
+			maxOutWeight = max(maxOutWeight, forwardSearchGraph.getEdgeTime(f));
+		}
+		if (targets.empty()) return;
 
 		FORALL_OUTGOING_EDGES(backwardSearchGraph, v, e) {
 			if (!backwardSearchGraph.isValidEdge(e)) continue;
 			unsigned u = backwardSearchGraph.getEdgeHead(e);
+			witnessSearch.findWitnesses(u, v, targets, backwardSearchGraph.getEdgeTime(e) + maxOutWeight);
+			decisions.settledNodes += witnessSearch.getSettledNodes();
 			FORALL_OUTGOING_EDGES(forwardSearchGraph, v, f) {
 				if (!forwardSearchGraph.isValidEdge(f)) continue;
 				unsigned w = forwardSearchGraph.getEdgeHead(f);
+				if (w == u) continue;
 				edgeCost shortcutWeight;
-				shortcutWeight.timeCost = backwardSearchGraph.getEdgeWeight(e).timeCost + forwardSearchGraph.getEdgeWeight(f).timeCost;
-				shortcutWeight.energyCost = edgeConsumptionProfileCombine(backwardSearchGraph.getEdgeWeight(e).energyCost, forwardSearchGraph.getEdgeWeight(f).energyCost);
-				if (witnessSearch.isNecessary(u, w, v, shortcutWeight.timeCost)) 
-				{
-				    
-				    	shortcutNumber++;
-					edgesInCore++;
-					
-					//if there is an existed edge but with bigger weight, the new shortcut will be necessary, but the number of edges in core should not change
-					FORALL_OUTGOING_EDGES(forwardSearchGraph,u,e)
-					{
-					    if(!forwardSearchGraph.isValidEdge(e))
-						continue;
-					     unsigned target  = forwardSearchGraph.getEdgeHead(e);
-					    if(target == w)
-					    {
-						edgesInCore--;
-					    }
-					}
-					
-					unsigned originalEdges = backwardSearchGraph.getOriginalEdges(e) + forwardSearchGraph.getOriginalEdges(f);
-					forwardSearchGraph.addEdge(u, w, shortcutWeight, originalEdges);
-					backwardSearchGraph.addEdge(w, u, shortcutWeight, originalEdges);
-					graph.addEdge(u, w, shortcutWeight);
-//					cout<<"shortcut added: from "<<u<<" to "<<w <<" with weight "<<shortcutWeight.timeCost<<endl;
+				shortcutWeight.timeCost = backwardSearchGraph.getEdgeTime(e) + forwardSearchGraph.getEdgeTime(f);
+				shortcutWeight.energyCost = edgeConsumptionProfileCombine(backwardSearchGraph.getEdgeEnergy(e), forwardSearchGraph.getEdgeEnergy(f));
+				edgeCost witness = witnessSearch.getDistance(w);
+				if (witness.timeCost > shortcutWeight.timeCost)
+					decisions.addedForTime++;
+				else if (witnessSearch.isEnergyAware() && !edgeCostDominates(witness, shortcutWeight))
+					decisions.addedForEnergy++;
+				else {
+					decisions.avoided++;
+					continue;
 				}
+				unsigned originalEdges = backwardSearchGraph.getOriginalEdges(e) + forwardSearchGraph.getOriginalEdges(f);
+				shortcuts.push_back({ u, w, shortcutWeight, originalEdges });
 			}
 		}
+	}
+
+	void applyContraction(unsigned v, const vector<shortcut>& shortcuts) {
+		graphVersion++;
 
+		vector<unsigned> forwardNeighbors;
+		vector<unsigned> backwardNeighbors;
+
+		FORALL_OUTGOING_EDGES(forwardSearchGraph, v, e) {
+			if (!forwardSearchGraph.isValidEdge(e)) continue;
+			forwardNeighbors.push_back(forwardSearchGraph.getEdgeHead(e));
+		}
+
+		FORALL_OUTGOING_EDGES(backwardSearchGraph, v, e) {
+			if (!backwardSearchGraph.isValidEdge(e)) continue;
+			backwardNeighbors.push_back(backwardSearchGraph.getEdgeHead(e));
+		}
+
+		unsigned long long insertionBegin = get_cycle_count();
+		for (unsigned i = 0; i < shortcuts.size(); i++) {
+			unsigned u = shortcuts[i].from;
+			unsigned w = shortcuts[i].to;
+
+			shortcutNumber++;
+
+			//a shortcut that replaces an existing edge does not change the number of edges in the core
+			unsigned edgesBefore = forwardSearchGraph.outgoingEdgeNumber(u);
+			if (witnessSearch.isEnergyAware()) {
+				forwardSearchGraph.addNonDominatedEdge(u, w, shortcuts[i].weight, shortcuts[i].originalEdges);
+				backwardSearchGraph.addNonDominatedEdge(w, u, shortcuts[i].weight, shortcuts[i].originalEdges);
+				graph.addNonDominatedEdge(u, w, shortcuts[i].weight);
+			}
+			else {
+				forwardSearchGraph.addEdge(u, w, shortcuts[i].weight, shortcuts[i].originalEdges);
+				backwardSearchGraph.addEdge(w, u, shortcuts[i].weight, shortcuts[i].originalEdges);
+				graph.addEdge(u, w, shortcuts[i].weight);
+			}
+			edgesInCore += forwardSearchGraph.outgoingEdgeNumber(u) - edgesBefore;
+//			cout<<"shortcut added: from "<<u<<" to "<<w <<" with weight "<<shortcuts[i].weight.timeCost<<endl;
+		}
+
+		unsigned long long deletionBegin = get_cycle_count();
+		telemetry.addCycles(insertionPhase, deletionBegin - insertionBegin);
 		for (unsigned i = 0; i < forwardNeighbors.size(); i++) {
 			unsigned e = forwardSearchGraph.getEdge(v, forwardNeighbors[i]);
 			assert(e != -1);
@@ -312,6 +636,7 @@ public:
 			assert(f != -1);
 			forwardSearchGraph.deleteEdge(backwardNeighbors[i], f);
 		}
+		telemetry.addCycles(deletionPhase, get_cycle_count() - deletionBegin);
 		
 		vector<unsigned> neighbors = forwardNeighbors;
 		neighbors.insert(neighbors.end(), backwardNeighbors.begin(), backwardNeighbors.end());
@@ -320,7 +645,6 @@ public:
 		edgesInCore = edgesInCore - neighbors.size();
 //		cout<<"edgesInCore: "<<edgesInCore<<endl;
 	}
-
 };
 
 #endif /* CONTRACTIONBUILDER_H_ */
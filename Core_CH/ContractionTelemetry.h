@@ -0,0 +1,248 @@
+#ifndef CONTRACTIONTELEMETRY_H_
+#define CONTRACTIONTELEMETRY_H_
+
+#include "Graph.h"
+#include "timer.h"
+#include <ostream>
+
+//! The parts of the contraction that are timed. keyPhase holds the key updates and the queue, i.e., everything
+//! that is not a witness search or a change of the graph.
+enum contractionPhase { keyPhase, witnessPhase, insertionPhase, deletionPhase, contractionPhaseNumber };
+
+//! One contracted node. degree counts its remaining in- and out-neighbors, witnessSettled the nodes settled by the
+//! witness searches that decided its shortcuts. round is 0 for ContractionBuilder::run.
+struct contractionRecord
+{
+	unsigned node;
+	unsigned round;
+	unsigned degree;
+	unsigned shortcuts;
+	unsigned witnessSettled;
+	unsigned remainingNodes;
+	unsigned edgesInCore;
+};
+
+//! The contractions between two summaries.
+struct contractionInterval
+{
+	unsigned contracted;
+	unsigned remainingNodes;
+	unsigned edgesInCore;
+	unsigned long long shortcuts;
+	unsigned long long degreeSum;
+	unsigned maxDegree;
+	unsigned long long witnessSettled;
+	unsigned long long cycles[contractionPhaseNumber];
+	//! Microseconds from the begin of the contraction to the end of the interval.
+	long long time;
+};
+
+//! Progress and profile of one contraction. The latest records are kept in a ring buffer of fixed capacity,
+//! every summaryInterval contractions the interval is closed and, if a stream is set, summarized in one line.
+//! writeJSON reports the totals, the intervals and the buffered records.
+//! The phases are timed with get_cycle_count. Run sequentially, every witness search is counted as witnessPhase.
+//! ContractionBuilder::runParallel times its sections instead, so there the witness searches of the key updates count as keyPhase.
+class ContractionTelemetry {
+
+private:
+	vector<contractionRecord> ring;
+	unsigned long long recorded;
+	unsigned summaryInterval;
+	ostream* summaryStream;
+
+	contractionInterval total;
+	contractionInterval current;
+	vector<contractionInterval> intervals;
+	long long beginTime;
+
+	//the counters at the last bookSequential
+	unsigned long long bookedCycles;
+	unsigned long long bookedWitnessCycles;
+	unsigned long long bookedWitnessSettled;
+	unsigned long long bookedGraphCycles;
+
+public:
+	ContractionTelemetry(unsigned capacity = 4096, unsigned summaryInterval = 10000, ostream* summaryStream = &cout) :
+		ring(capacity),
+		recorded(0),
+		summaryInterval(summaryInterval),
+		summaryStream(summaryStream),
+		beginTime(get_micro_time()),
+		bookedCycles(0),
+		bookedWitnessCycles(0),
+		bookedWitnessSettled(0),
+		bookedGraphCycles(0)
+	{
+		assert(capacity > 0);
+		total = emptyInterval();
+		current = emptyInterval();
+	}
+
+	//! Records per summary, 0 for none. Without a stream the intervals are only kept for writeJSON.
+	void setSummary(unsigned interval, ostream* stream) {
+		summaryInterval = interval;
+		summaryStream = stream;
+	}
+
+	ostream* getSummaryStream() const { return summaryStream; }
+
+	void setCapacity(unsigned capacity) {
+		assert(capacity > 0);
+		ring.assign(capacity, contractionRecord());
+		recorded = 0;
+	}
+
+	//! Starts a new contraction, the earlier records are dropped.
+	//! witnessCycles and witnessSettled are the current totals of the witness search used by bookSequential.
+	void begin(unsigned remainingNodes, unsigned edgesInCore, unsigned long long witnessCycles = 0, unsigned long long witnessSettled = 0) {
+		recorded = 0;
+		intervals.clear();
+		total = emptyInterval();
+		current = emptyInterval();
+		total.remainingNodes = current.remainingNodes = remainingNodes;
+		total.edgesInCore = current.edgesInCore = edgesInCore;
+		beginTime = get_micro_time();
+		bookedCycles = get_cycle_count();
+		bookedWitnessCycles = witnessCycles;
+		bookedWitnessSettled = witnessSettled;
+		bookedGraphCycles = 0;
+	}
+
+	//! For a sequential contraction: books the time since the last call. The growth of the witness search totals
+	//! goes to witnessPhase, the rest that the graph changes did not book to keyPhase.
+	void bookSequential(unsigned long long witnessCycles, unsigned long long witnessSettled) {
+		unsigned long long now = get_cycle_count();
+		unsigned long long graphCycles = total.cycles[insertionPhase] + total.cycles[deletionPhase];
+		unsigned long long witness = witnessCycles - bookedWitnessCycles;
+		unsigned long long other = witness + graphCycles - bookedGraphCycles;
+		addCycles(witnessPhase, witness);
+		addCycles(keyPhase, now - bookedCycles > other ? now - bookedCycles - other : 0);
+		addWitnessSettled(witnessSettled - bookedWitnessSettled);
+		bookedCycles = now;
+		bookedWitnessCycles = witnessCycles;
+		bookedWitnessSettled = witnessSettled;
+		bookedGraphCycles = graphCycles;
+	}
+
+	void addCycles(contractionPhase phase, unsigned long long cycles) {
+		total.cycles[phase] += cycles;
+		current.cycles[phase] += cycles;
+	}
+
+	//! Nodes settled by witness searches. The witnessSettled of the records is not added, it is part of these.
+	void addWitnessSettled(unsigned long long settled) {
+		total.witnessSettled += settled;
+		current.witnessSettled += settled;
+	}
+
+	void record(const contractionRecord& r) {
+		ring[recorded % ring.size()] = r;
+		recorded++;
+		add(total, r);
+		add(current, r);
+		if (summaryInterval != 0 && current.contracted >= summaryInterval)
+			closeInterval();
+	}
+
+	//! Closes the last interval and writes the final summary.
+	void finish() {
+		if (current.contracted > 0)
+			closeInterval();
+		total.time = get_micro_time() - beginTime;
+		if (summaryStream != NULL) {
+			*summaryStream << "contraction finished: ";
+			summarize(*summaryStream, total);
+			summaryStream->flush();
+		}
+	}
+
+	const contractionInterval& getTotal() const { return total; }
+	const vector<contractionInterval>& getIntervals() const { return intervals; }
+
+	//! The buffered records, oldest first.
+	vector<contractionRecord> getRecords() const {
+		vector<contractionRecord> records;
+		unsigned long long first = recorded > ring.size() ? recorded - ring.size() : 0;
+		for (unsigned long long i = first; i < recorded; i++)
+			records.push_back(ring[i % ring.size()]);
+		return records;
+	}
+
+	void writeJSON(ostream& out) const {
+		double cyclesPerMicroSecond = get_cycles_per_micro_second();
+		out << "{\n  \"total\": ";
+		writeInterval(out, total, cyclesPerMicroSecond);
+		out << ",\n  \"intervals\": [";
+		for (unsigned i = 0; i < intervals.size(); i++) {
+			out << (i == 0 ? "\n    " : ",\n    ");
+			writeInterval(out, intervals[i], cyclesPerMicroSecond);
+		}
+		out << "\n  ],\n  \"dropped_records\": " << (recorded > ring.size() ? recorded - ring.size() : 0) << ",\n  \"records\": [";
+		vector<contractionRecord> records = getRecords();
+		for (unsigned i = 0; i < records.size(); i++) {
+			const contractionRecord& r = records[i];
+			out << (i == 0 ? "\n    " : ",\n    ")
+				<< "{\"node\": " << r.node << ", \"round\": " << r.round << ", \"degree\": " << r.degree
+				<< ", \"shortcuts\": " << r.shortcuts << ", \"witness_settled\": " << r.witnessSettled
+				<< ", \"remaining_nodes\": " << r.remainingNodes << ", \"edges_in_core\": " << r.edgesInCore << "}";
+		}
+		out << "\n  ]\n}\n";
+	}
+
+private:
+	static contractionInterval emptyInterval() {
+		contractionInterval interval = { 0, 0, 0, 0, 0, 0, 0, { 0, 0, 0, 0 }, 0 };
+		return interval;
+	}
+
+	static void add(contractionInterval& interval, const contractionRecord& r) {
+		interval.contracted++;
+		interval.remainingNodes = r.remainingNodes;
+		interval.edgesInCore = r.edgesInCore;
+		interval.shortcuts += r.shortcuts;
+		interval.degreeSum += r.degree;
+		interval.maxDegree = max(interval.maxDegree, r.degree);
+	}
+
+	void closeInterval() {
+		current.time = get_micro_time() - beginTime;
+		intervals.push_back(current);
+		if (summaryStream != NULL)
+			summarize(*summaryStream, current);
+		contractionInterval next = emptyInterval();
+		next.remainingNodes = current.remainingNodes;
+		next.edgesInCore = current.edgesInCore;
+		current = next;
+	}
+
+	//! One line, flushed only by the end of the contraction.
+	static void summarize(ostream& out, const contractionInterval& interval) {
+		unsigned long long cycles = 0;
+		for (unsigned p = 0; p < contractionPhaseNumber; p++)
+			cycles += interval.cycles[p];
+		out << interval.contracted << " contracted, " << interval.remainingNodes << " left, "
+			<< interval.shortcuts << " shortcuts, " << interval.edgesInCore << " edges in core, degree "
+			<< (interval.contracted == 0 ? 0 : (double)interval.degreeSum / interval.contracted) << " mean / " << interval.maxDegree << " max"
+			<< " (remaining " << (interval.remainingNodes == 0 ? 0 : (double)interval.edgesInCore / interval.remainingNodes) << ")"
+			<< ", witness settled " << interval.witnessSettled << ", " << interval.time / 1000000.0 << " s";
+		if (cycles != 0)
+			out << ", key " << 100 * interval.cycles[keyPhase] / cycles << "% witness " << 100 * interval.cycles[witnessPhase] / cycles
+				<< "% insertion " << 100 * interval.cycles[insertionPhase] / cycles << "% deletion " << 100 * interval.cycles[deletionPhase] / cycles << "%";
+		out << "\n";
+	}
+
+	static void writeInterval(ostream& out, const contractionInterval& interval, double cyclesPerMicroSecond) {
+		static const char* phaseName[] = { "key", "witness", "insertion", "deletion" };
+		out << "{\"contracted\": " << interval.contracted << ", \"remaining_nodes\": " << interval.remainingNodes
+			<< ", \"edges_in_core\": " << interval.edgesInCore << ", \"shortcuts\": " << interval.shortcuts
+			<< ", \"mean_degree\": " << (interval.contracted == 0 ? 0 : (double)interval.degreeSum / interval.contracted)
+			<< ", \"max_degree\": " << interval.maxDegree
+			<< ", \"remaining_degree\": " << (interval.remainingNodes == 0 ? 0 : (double)interval.edgesInCore / interval.remainingNodes)
+			<< ", \"witness_settled\": " << interval.witnessSettled << ", \"time_us\": " << interval.time << ", \"phases_us\": {";
+		for (unsigned p = 0; p < contractionPhaseNumber; p++)
+			out << (p == 0 ? "" : ", ") << "\"" << phaseName[p] << "\": " << interval.cycles[p] / cyclesPerMicroSecond;
+		out << "}}";
+	}
+};
+
+#endif /* CONTRACTIONTELEMETRY_H_ */
@@ -0,0 +1,155 @@
+#ifndef CORECHQUERY_H_
+#define CORECHQUERY_H_
+
+#include "CHQuery.h"
+
+//! Query on a hierarchy whose last coreSize nodes in order were left uncontracted by ContractionBuilder::run(coreSize).
+//! First both searches go upward until they reach core nodes, then a bidirectional Dijkstra inside the core
+//! starts from the reached core nodes.
+class CoreCHQuery : public QueryContext {
+
+private:
+	shared_ptr<const CHIndex> index;
+	vector<unsigned> forwardEntry;
+	vector<unsigned> backwardEntry;
+
+public:
+	CoreCHQuery(const adjacencyGraph& graph, vector<unsigned>& order, unsigned coreSize) :
+		QueryContext(graph.vertexNumber()),
+		index(make_shared<CHIndex>(graph, order, coreSize))
+	{ }
+
+	//! Uses a shared index, e.g., one mapped from a CHFile, whose core size is stored in the index.
+	CoreCHQuery(shared_ptr<const CHIndex> index) :
+		QueryContext(index->vertexNumber()),
+		index(index)
+	{ }
+
+	bool inCore(unsigned v) const { return index->getCore()[index->toInternal(v)]; }
+
+	edgeCost run(unsigned source, unsigned target) {
+		CORE_CH_SEARCH(core_ch_query_search);
+		const unsigned char* isCore = index->getCore();
+		source = index->toInternal(source);
+		target = index->toInternal(target);
+		runTime++;
+		settledNodes = 0;
+		relaxedEdges = 0;
+		edgeConsumptionProfile initial = { 0 , maxCapacity , 0 };
+		forwardQueue.clear();
+		backwardQueue.clear();
+		forwardEntry.clear();
+		backwardEntry.clear();
+		tentativeDistance = { inf_weight , initial };
+		forwardCount[source] = runTime;
+		forwardCost[source] = { 0 , initial };
+		backwardCount[target] = runTime;
+		backwardCost[target] = { 0 , initial };
+		if (source == target)
+			return { 0 , initial };
+		forwardQueue.push({source, forwardCost[source]});
+		backwardQueue.push({target, backwardCost[target]});
+
+		//Phase 1: upward searches outside of the core. Reached core nodes are not expanded yet.
+		//Each direction stops on its own once its smallest key reaches the tentative distance.
+		while (!forwardQueue.empty()) {
+			if (forwardQueue.peek().key.timeCost >= tentativeDistance.timeCost) break;
+			unsigned u = forwardQueue.pop().id;
+			if (isCore[u]) {
+				forwardEntry.push_back(u);
+				continue;
+			}
+			relaxForward(u);
+		}
+
+		while (!backwardQueue.empty()) {
+			if (backwardQueue.peek().key.timeCost >= tentativeDistance.timeCost) break;
+			unsigned u = backwardQueue.pop().id;
+			if (isCore[u]) {
+				backwardEntry.push_back(u);
+				continue;
+			}
+			relaxBackward(u);
+		}
+
+		//Phase 2: bidirectional Dijkstra restricted to the core, started from all reached core nodes.
+		CORE_CH_PHASE(core_ch_query_search, core_phase);
+		CORE_CH_COUNT_N(core_ch_query_search, core_entries, forwardEntry.size() + backwardEntry.size());
+		forwardQueue.clear();
+		backwardQueue.clear();
+		for (unsigned i = 0; i < forwardEntry.size(); i++)
+			forwardQueue.push({forwardEntry[i], forwardCost[forwardEntry[i]]});
+		for (unsigned i = 0; i < backwardEntry.size(); i++)
+			backwardQueue.push({backwardEntry[i], backwardCost[backwardEntry[i]]});
+
+		while (!forwardQueue.empty() && !backwardQueue.empty()) {
+			unsigned forwardMin = forwardQueue.peek().key.timeCost;
+			unsigned backwardMin = backwardQueue.peek().key.timeCost;
+			if (forwardMin + backwardMin >= tentativeDistance.timeCost) break;
+			if (forwardMin <= backwardMin)
+				relaxForward(forwardQueue.pop().id);
+			else
+				relaxBackward(backwardQueue.pop().id);
+		}
+
+		CORE_CH_COUNT_N(core_ch_query_search, settled_nodes, settledNodes);
+		CORE_CH_COUNT_N(core_ch_query_search, relaxed_edges, relaxedEdges);
+		return tentativeDistance;
+	}
+
+private:
+	//! The graphs of the index only hold usable edges: outside of the core the upward ones,
+	//! inside the core the edges between core nodes.
+	void relaxForward(unsigned u) {
+		const adjacencyGraphView& forwardGraph = index->getForwardGraph();
+		settledNodes++;
+		edgeCost distanceU = getForwardCost(u);
+		FORALL_OUTGOING_EDGES(forwardGraph, u, e) {
+			unsigned v = forwardGraph.getEdgeHead(e);
+			relaxedEdges++;
+			edgeCost distanceV = getForwardCost(v);
+			if (distanceU.timeCost + forwardGraph.getEdgeTime(e) < distanceV.timeCost) {
+				forwardCost[v].timeCost = distanceU.timeCost + forwardGraph.getEdgeTime(e);
+				forwardCost[v].energyCost = edgeConsumptionProfileCombine(distanceU.energyCost, forwardGraph.getEdgeEnergy(e));
+				if (forwardQueue.contains_id(v)) {
+					forwardQueue.decrease_key({v, forwardCost[v]});
+					CORE_CH_COUNT(core_ch_query_search, decrease_keys);
+				}
+				else
+					forwardQueue.push({v, forwardCost[v]});
+				if (forwardCost[v].timeCost + getBackwardCost(v).timeCost < tentativeDistance.timeCost) {
+					tentativeDistance.timeCost = forwardCost[v].timeCost + backwardCost[v].timeCost;
+					tentativeDistance.energyCost = edgeConsumptionProfileCombine(forwardCost[v].energyCost, backwardCost[v].energyCost);
+				}
+			}
+		}
+	}
+
+	void relaxBackward(unsigned u) {
+		const adjacencyGraphView& backwardGraph = index->getBackwardGraph();
+		settledNodes++;
+		edgeCost distanceU = getBackwardCost(u);
+		FORALL_OUTGOING_EDGES(backwardGraph, u, e) {
+			unsigned v = backwardGraph.getEdgeHead(e);
+			relaxedEdges++;
+			edgeCost distanceV = getBackwardCost(v);
+			if (distanceU.timeCost + backwardGraph.getEdgeTime(e) < distanceV.timeCost) {
+				backwardCost[v].timeCost = distanceU.timeCost + backwardGraph.getEdgeTime(e);
+				//the backward search walks the path from its end, so the new edge comes first
+				backwardCost[v].energyCost = edgeConsumptionProfileCombine(backwardGraph.getEdgeEnergy(e), distanceU.energyCost);
+				if (backwardQueue.contains_id(v)) {
+					backwardQueue.decrease_key({v, backwardCost[v]});
+					CORE_CH_COUNT(core_ch_query_search, decrease_keys);
+				}
+				else
+					backwardQueue.push({v, backwardCost[v]});
+				if (getForwardCost(v).timeCost + backwardCost[v].timeCost < tentativeDistance.timeCost) {
+					tentativeDistance.timeCost = forwardCost[v].timeCost + backwardCost[v].timeCost;
+					tentativeDistance.energyCost = edgeConsumptionProfileCombine(forwardCost[v].energyCost, backwardCost[v].energyCost);
+				}
+			}
+		}
+	}
+};
+
+#endif /* CORECHQUERY_H_ */
@@ -0,0 +1,466 @@
+#ifndef CUSTOMIZABLECH_H_
+#define CUSTOMIZABLECH_H_
+
+#include "Graph.h"
+#include "RankRenumbering.h"
+#include "parallel_for.h"
+#include "timer.h"
+#include <cmath>
+
+//! Metric-independent contraction order by geometric nested dissection: a cell of the graph is split at the
+//! median of its longer side, a greedy vertex cover of the cut edges forms the separator, and both remaining
+//! halves are ordered recursively before the separator. Cells with at most leafSize vertices
+//! are not split. The order only depends on the topology and the coordinates, never on the weights.
+class NestedDissection {
+
+private:
+	vector<vector<unsigned> > neighbors;
+	const vector<float>& latitude;
+	const vector<float>& longitude;
+	unsigned leafSize;
+	vector<unsigned> cell;
+	vector<unsigned char> side;
+	vector<unsigned> cutDegree;
+	unsigned cellNumber;
+	vector<unsigned> order;
+
+public:
+	NestedDissection(const adjacencyGraph& graph, const vector<float>& latitude, const vector<float>& longitude, unsigned leafSize = 64) :
+		neighbors(graph.vertexNumber()),
+		latitude(latitude),
+		longitude(longitude),
+		leafSize(max(leafSize, 1u)),
+		cell(graph.vertexNumber(), 0),
+		side(graph.vertexNumber(), 0),
+		cutDegree(graph.vertexNumber(), 0),
+		cellNumber(0)
+	{
+		if (latitude.size() != graph.vertexNumber() || longitude.size() != graph.vertexNumber())
+			throw std::runtime_error("The coordinates do not fit the graph.");
+		//the direction of the edges does not matter for the separators
+		FORALL_VERTICES(graph, u) {
+			FORALL_OUTGOING_EDGES(graph, u, e) {
+				unsigned v = graph.getEdgeHead(e);
+				if (u == v) continue;
+				neighbors[u].push_back(v);
+				neighbors[v].push_back(u);
+			}
+		}
+		for (unsigned u = 0; u < neighbors.size(); u++) {
+			sort(neighbors[u].begin(), neighbors[u].end());
+			neighbors[u].erase(unique(neighbors[u].begin(), neighbors[u].end()), neighbors[u].end());
+		}
+	}
+
+	//! order[i] is the vertex with rank i, as ContractionBuilder::getOrder returns it.
+	vector<unsigned> run() {
+		order.clear();
+		vector<unsigned> all(neighbors.size());
+		for (unsigned v = 0; v < all.size(); v++)
+			all[v] = v;
+		dissect(all);
+		assert(order.size() == neighbors.size());
+		return order;
+	}
+
+private:
+	void dissect(vector<unsigned>& vertices) {
+		if (vertices.size() <= leafSize) {
+			order.insert(order.end(), vertices.begin(), vertices.end());
+			return;
+		}
+
+		//split at the median of the longer side, longitudes shrink with the cosine of the latitude
+		float minLatitude = latitude[vertices[0]], maxLatitude = minLatitude;
+		float minLongitude = longitude[vertices[0]], maxLongitude = minLongitude;
+		for (unsigned i = 1; i < vertices.size(); i++) {
+			minLatitude = min(minLatitude, latitude[vertices[i]]);
+			maxLatitude = max(maxLatitude, latitude[vertices[i]]);
+			minLongitude = min(minLongitude, longitude[vertices[i]]);
+			maxLongitude = max(maxLongitude, longitude[vertices[i]]);
+		}
+		float scale = cos((minLatitude + maxLatitude) / 2 * 3.14159265f / 180);
+		const vector<float>& axis = (maxLongitude - minLongitude) * scale > maxLatitude - minLatitude ? longitude : latitude;
+		unsigned half = vertices.size() / 2;
+		nth_element(vertices.begin(), vertices.begin() + half, vertices.end(), [&](unsigned a, unsigned b) {
+			return axis[a] < axis[b] || (axis[a] == axis[b] && a < b);
+		});
+
+		unsigned id = ++cellNumber;
+		for (unsigned i = 0; i < vertices.size(); i++) {
+			cell[vertices[i]] = id;
+			side[vertices[i]] = i >= half;
+		}
+		//the separator covers every cut edge, greedily by the endpoint with more cut edges
+		vector<pair<unsigned, unsigned> > cut;
+		for (unsigned i = 0; i < vertices.size(); i++) {
+			unsigned u = vertices[i];
+			cutDegree[u] = 0;
+			for (unsigned j = 0; j < neighbors[u].size(); j++) {
+				unsigned v = neighbors[u][j];
+				if (cell[v] == id && side[v] != side[u]) {
+					cutDegree[u]++;
+					if (u < v) cut.push_back(make_pair(u, v));
+				}
+			}
+		}
+		vector<unsigned> separator;
+		for (unsigned i = 0; i < cut.size(); i++) {
+			unsigned u = cut[i].first, v = cut[i].second;
+			if (side[u] == 2 || side[v] == 2) continue;
+			unsigned w = cutDegree[u] >= cutDegree[v] ? u : v;
+			side[w] = 2;
+			separator.push_back(w);
+		}
+
+		vector<unsigned> part[2];
+		for (unsigned i = 0; i < vertices.size(); i++) {
+			if (side[vertices[i]] != 2)
+				part[side[vertices[i]]].push_back(vertices[i]);
+		}
+		vector<unsigned>().swap(vertices);
+		dissect(part[0]);
+		dissect(part[1]);
+		order.insert(order.end(), separator.begin(), separator.end());
+	}
+};
+
+//! A new weight for the input edge with the given ID.
+struct weightUpdate
+{
+	unsigned edge;
+	edgeCost weight;
+};
+
+//! Work of CustomizableCH::update. A full customization examines every triangle of the hierarchy once.
+struct updateStatistics
+{
+	unsigned updatedEdges;
+	unsigned recomputedEdges;
+	unsigned changedEdges;
+	unsigned long long examinedTriangles;
+	unsigned long long fullTriangles;
+	long long time;
+};
+
+//! A customizable contraction hierarchy: the shortcuts follow from the order alone, because contracting a vertex
+//! connects all its higher ranked neighbors, whatever the weights are. The constructor computes this topology once;
+//! customize then derives the weights of all edges, shortcuts included, from new travel times and energy values.
+//! It processes the edges bottom up: the edge from y to w is improved by every lower triangle x, i.e., by the paths
+//! y->x->w over a lower neighbor x of both. All vertices of one level, whose lower neighbors all have lower levels,
+//! are customized in parallel. A shortcut gets the energy profile of its fastest path (see edgeConsumptionProfileCombine);
+//! among paths of equal time the one with the dominating profile.
+//!
+//! update repairs the weights after a batch of changed input edges without touching the rest: the higher edges of a
+//! vertex are recomputed from their input edges and lower triangles only if one of these changed, starting at the
+//! updated input edges and moving up the hierarchy level by level. The topology and the order never change.
+//! A change close to the top separators reaches most of the hierarchy, so batches spread over the whole graph
+//! are not faster than customize; the statistics tell how much of a full customization an update took.
+//!
+//! getAugmentedGraph and getOrder have the meaning of those of ContractionBuilder, so the result is used with
+//! CHIndex and saveCHFile as any other hierarchy. Every suffix of the order preserves the distances between its
+//! vertices, so any coreSize can be passed to CHIndex, but charging stations are not pinned to the core.
+class CustomizableCH {
+
+private:
+	vector<unsigned> order;
+	RankRenumbering renumbering;
+
+	//the edges from a vertex x to its higher neighbors y, sorted by y; edge e is the position in upHead
+	vector<unsigned> upFirstOut;
+	vector<unsigned> upHead;
+	vector<unsigned> upTail;
+	//the same edges seen from their upper end y, sorted by x
+	vector<unsigned> downFirstOut;
+	vector<unsigned> downTail;
+	vector<unsigned> downEdge;
+	//vertices grouped by level, a level only has lower neighbors in lower levels
+	vector<unsigned> levelFirst;
+	vector<unsigned> levelVertices;
+
+	//the edge of the hierarchy of every input edge and whether it leads upward, invalid_id for loops
+	vector<unsigned> inputEdge;
+	vector<bool> inputUpward;
+	//the input edges of every edge of the hierarchy
+	vector<unsigned> edgeInputFirst;
+	vector<unsigned> edgeInputs;
+	vector<edgeCost> inputWeight;
+	unsigned long long triangleNumber;
+	//the vertices whose higher edges update has to recompute
+	vector<bool> dirty;
+
+	//upWeight[e] is the weight from x to y, downWeight[e] the one from y to x
+	vector<edgeCost> upWeight;
+	vector<edgeCost> downWeight;
+
+public:
+	CustomizableCH(const adjacencyGraph& graph, const vector<unsigned>& order) :
+		order(order),
+		renumbering(order),
+		inputEdge(graph.edgeNumber(), invalid_id),
+		inputUpward(graph.edgeNumber()),
+		triangleNumber(0)
+	{
+		if (order.size() != graph.vertexNumber())
+			throw std::runtime_error("The order does not fit the graph.");
+		const unsigned n = graph.vertexNumber();
+
+		//contracting x adds the edges between its higher neighbors, which are then all neighbors of the lowest one
+		vector<vector<unsigned> > higher(n);
+		FORALL_VERTICES(graph, u) {
+			FORALL_OUTGOING_EDGES(graph, u, e) {
+				unsigned x = renumbering.toInternal(u), y = renumbering.toInternal(graph.getEdgeHead(e));
+				if (x != y) higher[min(x, y)].push_back(max(x, y));
+			}
+		}
+		upFirstOut.resize(n + 1);
+		for (unsigned x = 0; x < n; x++) {
+			sort(higher[x].begin(), higher[x].end());
+			higher[x].erase(unique(higher[x].begin(), higher[x].end()), higher[x].end());
+			if (higher[x].size() > 1) {
+				vector<unsigned>& parent = higher[higher[x][0]];
+				parent.insert(parent.end(), higher[x].begin() + 1, higher[x].end());
+			}
+			upFirstOut[x] = upHead.size();
+			upHead.insert(upHead.end(), higher[x].begin(), higher[x].end());
+			vector<unsigned>().swap(higher[x]);
+		}
+		upFirstOut[n] = upHead.size();
+		upTail.resize(upHead.size());
+		for (unsigned x = 0; x < n; x++) {
+			for (unsigned e = upFirstOut[x]; e < upFirstOut[x + 1]; e++) {
+				upTail[e] = x;
+				triangleNumber += upFirstOut[x + 1] - e - 1;
+			}
+		}
+
+		downFirstOut.assign(n + 1, 0);
+		for (unsigned e = 0; e < upHead.size(); e++)
+			downFirstOut[upHead[e] + 1]++;
+		for (unsigned y = 0; y < n; y++)
+			downFirstOut[y + 1] += downFirstOut[y];
+		downTail.resize(upHead.size());
+		downEdge.resize(upHead.size());
+		vector<unsigned> next(downFirstOut.begin(), downFirstOut.end() - 1);
+		vector<unsigned> level(n, 0);
+		unsigned levelNumber = 0;
+		for (unsigned x = 0; x < n; x++) {
+			for (unsigned e = upFirstOut[x]; e < upFirstOut[x + 1]; e++) {
+				unsigned y = upHead[e];
+				downTail[next[y]] = x;
+				downEdge[next[y]] = e;
+				next[y]++;
+				level[y] = max(level[y], level[x] + 1);
+			}
+			levelNumber = max(levelNumber, level[x] + 1);
+		}
+
+		levelFirst.assign(levelNumber + 1, 0);
+		for (unsigned x = 0; x < n; x++)
+			levelFirst[level[x] + 1]++;
+		for (unsigned l = 0; l < levelNumber; l++)
+			levelFirst[l + 1] += levelFirst[l];
+		levelVertices.resize(n);
+		next.assign(levelFirst.begin(), levelFirst.end() - 1);
+		for (unsigned x = 0; x < n; x++)
+			levelVertices[next[level[x]]++] = x;
+
+		FORALL_VERTICES(graph, u) {
+			FORALL_OUTGOING_EDGES(graph, u, e) {
+				unsigned x = renumbering.toInternal(u), y = renumbering.toInternal(graph.getEdgeHead(e));
+				if (x == y) continue;
+				inputEdge[e] = findEdge(min(x, y), max(x, y));
+				inputUpward[e] = x < y;
+			}
+		}
+
+		edgeInputFirst.assign(edgeNumber() + 1, 0);
+		for (unsigned e = 0; e < inputEdge.size(); e++)
+			if (inputEdge[e] != invalid_id) edgeInputFirst[inputEdge[e] + 1]++;
+		for (unsigned e = 0; e < edgeNumber(); e++)
+			edgeInputFirst[e + 1] += edgeInputFirst[e];
+		edgeInputs.resize(edgeInputFirst[edgeNumber()]);
+		next.assign(edgeInputFirst.begin(), edgeInputFirst.end() - 1);
+		for (unsigned e = 0; e < inputEdge.size(); e++)
+			if (inputEdge[e] != invalid_id) edgeInputs[next[inputEdge[e]]++] = e;
+		dirty.assign(n, false);
+	}
+
+	unsigned vertexNumber() const { return order.size(); }
+	//! Edges of the hierarchy, each of which has one weight per direction.
+	unsigned edgeNumber() const { return upHead.size(); }
+	unsigned levelNumber() const { return levelFirst.size() - 1; }
+
+	//! Computes the weights of all edges for new travel times and energy values of the input edges,
+	//! which are turned into profiles as weightGnerate does.
+	void customize(const vector<unsigned>& travelTime, const vector<int>& energy, unsigned threadNumber = 0) {
+		if (travelTime.size() != inputEdge.size() || energy.size() != inputEdge.size())
+			throw std::runtime_error("The weights do not fit the graph of the hierarchy.");
+		vector<edgeCost> weight(travelTime.size());
+		for (unsigned e = 0; e < weight.size(); e++)
+			weight[e] = { travelTime[e] , edgeConsumptionProfileTranform(maxCapacity, energy[e]) };
+		customize(weight, threadNumber);
+	}
+
+	//! Computes the weights of all edges for new weights of the input edges.
+	void customize(const vector<edgeCost>& weight, unsigned threadNumber = 0) {
+		if (weight.size() != inputEdge.size())
+			throw std::runtime_error("The weights do not fit the graph of the hierarchy.");
+		threadNumber = get_thread_count(threadNumber);
+		inputWeight = weight;
+		upWeight.resize(edgeNumber());
+		downWeight.resize(edgeNumber());
+		parallel_for(0, edgeNumber(), threadNumber, [&](unsigned e, unsigned) {
+			setInputWeight(e);
+		}, 1024);
+
+		for (unsigned l = 0; l < levelNumber(); l++) {
+			parallel_for(levelFirst[l], levelFirst[l + 1], threadNumber, [&](unsigned i, unsigned) {
+				customizeVertex(levelVertices[i]);
+			}, 16);
+		}
+	}
+
+	//! Changes the weights of some input edges and repairs the weights of the edges that depend on them.
+	//! Needs a previous customize. An input edge may appear several times, the last weight counts.
+	updateStatistics update(const vector<weightUpdate>& updates) {
+		if (inputWeight.empty())
+			throw std::runtime_error("The hierarchy has to be customized before it can be updated.");
+		long long beginTime = get_micro_time();
+		updateStatistics statistics = { (unsigned)updates.size() , 0 , 0 , 0 , triangleNumber , 0 };
+
+		for (unsigned i = 0; i < updates.size(); i++) {
+			if (updates[i].edge >= inputEdge.size())
+				throw std::runtime_error("An update refers to an edge that does not exist.");
+			inputWeight[updates[i].edge] = updates[i].weight;
+			if (inputEdge[updates[i].edge] != invalid_id)
+				dirty[upTail[inputEdge[updates[i].edge]]] = true;
+		}
+
+		//a vertex is repaired as in customize, its dirty successors have higher levels
+		vector<edgeCost> oldUp, oldDown;
+		for (unsigned l = 0; l < levelNumber(); l++) {
+			for (unsigned i = levelFirst[l]; i < levelFirst[l + 1]; i++) {
+				unsigned y = levelVertices[i];
+				if (!dirty[y]) continue;
+				dirty[y] = false;
+				oldUp.assign(upWeight.begin() + upFirstOut[y], upWeight.begin() + upFirstOut[y + 1]);
+				oldDown.assign(downWeight.begin() + upFirstOut[y], downWeight.begin() + upFirstOut[y + 1]);
+				for (unsigned e = upFirstOut[y]; e < upFirstOut[y + 1]; e++)
+					setInputWeight(e);
+				statistics.examinedTriangles += customizeVertex(y);
+				statistics.recomputedEdges += upFirstOut[y + 1] - upFirstOut[y];
+
+				//a changed edge (y, w) is a lower edge of the triangles of y with every other higher neighbor z
+				for (unsigned e = upFirstOut[y]; e < upFirstOut[y + 1]; e++) {
+					if (isEqual(oldUp[e - upFirstOut[y]], upWeight[e]) && isEqual(oldDown[e - upFirstOut[y]], downWeight[e])) continue;
+					statistics.changedEdges++;
+					for (unsigned f = upFirstOut[y]; f < upFirstOut[y + 1]; f++) {
+						if (f != e)
+							dirty[min(upHead[e], upHead[f])] = true;
+					}
+				}
+			}
+		}
+
+		statistics.time = get_micro_time() - beginTime;
+		return statistics;
+	}
+
+	vector<unsigned> getOrder() const { return order; }
+
+	//! The input edges and all shortcuts with their current weights in the original IDs.
+	//! Directions that can not be traveled are left out.
+	adjacencyGraph getAugmentedGraph() const {
+		const unsigned n = vertexNumber();
+		vector<unsigned> first_out(n + 1, 0);
+		for (unsigned x = 0; x < n; x++) {
+			for (unsigned e = upFirstOut[x]; e < upFirstOut[x + 1]; e++) {
+				if (upWeight[e].timeCost != inf_weight) first_out[renumbering.toExternal(x) + 1]++;
+				if (downWeight[e].timeCost != inf_weight) first_out[renumbering.toExternal(upHead[e]) + 1]++;
+			}
+		}
+		for (unsigned v = 0; v < n; v++)
+			first_out[v + 1] += first_out[v];
+
+		vector<unsigned> head(first_out[n]);
+		vector<edgeCost> weight(first_out[n]);
+		vector<unsigned> next(first_out.begin(), first_out.end() - 1);
+		for (unsigned x = 0; x < n; x++) {
+			unsigned u = renumbering.toExternal(x);
+			for (unsigned e = upFirstOut[x]; e < upFirstOut[x + 1]; e++) {
+				unsigned v = renumbering.toExternal(upHead[e]);
+				if (upWeight[e].timeCost != inf_weight) {
+					head[next[u]] = v;
+					weight[next[u]++] = upWeight[e];
+				}
+				if (downWeight[e].timeCost != inf_weight) {
+					head[next[v]] = u;
+					weight[next[v]++] = downWeight[e];
+				}
+			}
+		}
+		return adjacencyGraph(first_out, head, weight);
+	}
+
+private:
+	unsigned findEdge(unsigned x, unsigned y) const {
+		const unsigned* begin = &upHead[0] + upFirstOut[x];
+		const unsigned* end = &upHead[0] + upFirstOut[x + 1];
+		const unsigned* position = lower_bound(begin, end, y);
+		assert(position != end && *position == y);
+		return position - &upHead[0];
+	}
+
+	//! Both weights of edge e from its input edges alone; of parallel input edges the fastest one counts.
+	void setInputWeight(unsigned e) {
+		edgeConsumptionProfile initial = { 0 , maxCapacity , 0 };
+		upWeight[e] = { inf_weight , initial };
+		downWeight[e] = { inf_weight , initial };
+		for (unsigned i = edgeInputFirst[e]; i < edgeInputFirst[e + 1]; i++) {
+			unsigned input = edgeInputs[i];
+			improve(inputUpward[input] ? upWeight[e] : downWeight[e], inputWeight[input]);
+		}
+	}
+
+	static bool isEqual(const edgeCost& a, const edgeCost& b) {
+		return a.timeCost == b.timeCost && a.energyCost.in == b.energyCost.in
+			&& a.energyCost.out == b.energyCost.out && a.energyCost.cost == b.energyCost.cost;
+	}
+
+	static void improve(edgeCost& weight, const edgeCost& candidate) {
+		if (candidate.timeCost < weight.timeCost || (candidate.timeCost == weight.timeCost && edgeCostDominates(candidate, weight)))
+			weight = candidate;
+	}
+
+	static edgeCost combine(const edgeCost& first, const edgeCost& second) {
+		if (first.timeCost == inf_weight || second.timeCost == inf_weight) {
+			edgeConsumptionProfile initial = { 0 , maxCapacity , 0 };
+			return { inf_weight , initial };
+		}
+		return { first.timeCost + second.timeCost , edgeConsumptionProfileCombine(first.energyCost, second.energyCost) };
+	}
+
+	//! Improves the upper edges of y by all lower triangles. Only writes edges of y and only reads edges of lower levels.
+	//! Returns the number of triangles.
+	unsigned customizeVertex(unsigned y) {
+		unsigned triangles = 0;
+		for (unsigned d = downFirstOut[y]; d < downFirstOut[y + 1]; d++) {
+			unsigned x = downTail[d];
+			unsigned xy = downEdge[d];
+			//the higher neighbors of x above y are higher neighbors of y as well, both lists are sorted
+			unsigned yw = upFirstOut[y];
+			for (unsigned xw = xy + 1; xw < upFirstOut[x + 1]; xw++) {
+				while (upHead[yw] != upHead[xw])
+					yw++;
+				assert(yw < upFirstOut[y + 1]);
+				improve(upWeight[yw], combine(downWeight[xy], upWeight[xw]));
+				improve(downWeight[yw], combine(downWeight[xw], upWeight[xy]));
+			}
+			triangles += upFirstOut[x + 1] - xy - 1;
+		}
+		return triangles;
+	}
+};
+
+#endif /* CUSTOMIZABLECH_H_ */
@@ -0,0 +1,343 @@
+#ifndef EVQUERY_H_
+#define EVQUERY_H_
+
+#include "ParetoQuery.h"
+#include <stdexcept>
+
+//! Result of an EVQuery. timeCost includes the charging time and is inf_weight if no feasible route exists.
+struct chargingRoute
+{
+	unsigned timeCost;
+	int arrivalCharge;
+	vector<unsigned> chargingStops;
+};
+
+//! Fastest route for an electric vehicle whose battery must never run empty. The vehicle can stop at charging
+//! stations, which fill the battery to maxCapacity and take chargingTime each. Between two stops it may take any
+//! path whose consumption profile (see edgeConsumptionProfileCombine) fits the charge, not only the fastest one;
+//! charge above maxCapacity is lost.
+//!
+//! All searches are label-setting searches with ParetoBags, so every node keeps the non-dominated trade-offs
+//! between time and energy. They are only complete if the hierarchy keeps them, i.e., if it was contracted
+//! with energy aware witnesses (see CHIndex::keepsTradeOffs): then a shortcut is only left out if a witness
+//! dominates it, in the core as well as in the upward search spaces. Time-only witnesses drop slower but
+//! cheaper paths, so the constructor rejects such an index. With maxLabels the sets are bounded, which may
+//! lose feasible routes; the default keeps all trade-offs.
+//!
+//! The constructor computes the table of the fastest feasible legs between all stations, each started with a
+//! full battery, with one search per station. A query runs one forward and one backward search that settle the
+//! upward search spaces and the whole core, and then a Dijkstra on the complete graph of the available stations.
+//! Stations outside of the core, e.g., of a hierarchy built for other stations, are handled as by addStation.
+//!
+//! Stations can be disabled and enabled between queries. addStation opens a new station without touching the
+//! index: a station outside of the core keeps the upward search spaces from and to it up to the core, whose
+//! labels meet the core labels of the query searches as in ManyToManyQuery, and gets its row and column of
+//! the table from two searches.
+class EVQuery {
+
+private:
+	//! A label of an upward search space from or to a station outside of the core, up to and including the first core nodes.
+	struct bucketLabel {
+		unsigned node;
+		edgeCost cost;
+	};
+
+	shared_ptr<const CHIndex> index;
+	vector<unsigned> externalID;
+	vector<unsigned> station;
+	vector<bool> available;
+	vector<unsigned> stationIndex;
+	vector<vector<bucketLabel> > fromStation;
+	vector<vector<bucketLabel> > toStation;
+	vector<edgeCost> stationTable;
+	unsigned chargingTime;
+	ParetoBags forwardBags;
+	ParetoBags backwardBags;
+	unsigned settledLabels;
+	unsigned relaxedEdges;
+
+public:
+	//! chargingStation is indexed by the original IDs. Stations outside of the core get their upward search spaces
+	//! as addStation does.
+	EVQuery(shared_ptr<const CHIndex> index, const vector<bool>& chargingStation, unsigned chargingTime, unsigned maxLabels = invalid_id) :
+		index(index),
+		externalID(index->vertexNumber()),
+		stationIndex(index->vertexNumber(), invalid_id),
+		chargingTime(chargingTime),
+		forwardBags(index->vertexNumber(), maxLabels),
+		backwardBags(index->vertexNumber(), maxLabels),
+		settledLabels(0),
+		relaxedEdges(0)
+	{
+		if (!index->keepsTradeOffs())
+			throw std::invalid_argument("EVQuery needs a hierarchy contracted with energy aware witnesses.");
+		if (chargingStation.size() != index->vertexNumber())
+			throw std::runtime_error("The charging stations do not fit the index.");
+		for (unsigned v = 0; v < chargingStation.size(); v++) {
+			unsigned u = index->toInternal(v);
+			externalID[u] = v;
+			if (chargingStation[v])
+				station.push_back(u);
+		}
+		sort(station.begin(), station.end());
+		available.assign(station.size(), true);
+		fromStation.resize(station.size());
+		toStation.resize(station.size());
+		for (unsigned i = 0; i < station.size(); i++) {
+			stationIndex[station[i]] = i;
+			if (!index->getCore()[station[i]])
+				collectSearchSpaces(i);
+		}
+
+		stationTable.resize(station.size() * station.size());
+		for (unsigned i = 0; i < station.size(); i++) {
+			search(station[i], true);
+			for (unsigned j = 0; j < station.size(); j++)
+				stationTable[i * station.size() + j] = legToStation(j, maxCapacity);
+		}
+	}
+
+	unsigned getStationNumber() const { return station.size(); }
+
+	bool isStation(unsigned v) const { return stationIndex[index->toInternal(v)] != invalid_id; }
+
+	bool isStationAvailable(unsigned v) const {
+		unsigned i = stationIndex[index->toInternal(v)];
+		return i != invalid_id && available[i];
+	}
+
+	//! Disables or enables the station v, which takes effect with the next query.
+	void setStationAvailable(unsigned v, bool isAvailable) {
+		unsigned i = stationIndex[index->toInternal(v)];
+		if (i == invalid_id)
+			throw std::runtime_error("The node is no charging station.");
+		available[i] = isAvailable;
+	}
+
+	//! Opens a station at v, or enables it if v already is one. Costs two full searches from v and, for every
+	//! other station outside of the core, a scan of its upward search space.
+	void addStation(unsigned v) {
+		unsigned u = index->toInternal(v);
+		if (stationIndex[u] != invalid_id) {
+			available[stationIndex[u]] = true;
+			return;
+		}
+		const unsigned oldNumber = station.size();
+		const unsigned number = oldNumber + 1;
+		station.push_back(u);
+		available.push_back(true);
+		fromStation.push_back(vector<bucketLabel>());
+		toStation.push_back(vector<bucketLabel>());
+		stationIndex[u] = oldNumber;
+		if (!index->getCore()[u])
+			collectSearchSpaces(oldNumber);
+
+		vector<edgeCost> table(number * number);
+		for (unsigned i = 0; i < oldNumber; i++)
+			copy(stationTable.begin() + i * oldNumber, stationTable.begin() + (i + 1) * oldNumber, table.begin() + i * number);
+		search(u, true);
+		search(u, false);
+		for (unsigned j = 0; j < number; j++) {
+			table[oldNumber * number + j] = legToStation(j, maxCapacity);
+			table[j * number + oldNumber] = legFromStation(j);
+		}
+		edgeConsumptionProfile initial = { 0 , maxCapacity , 0 };
+		table[oldNumber * number + oldNumber] = { 0 , initial };
+		stationTable.swap(table);
+	}
+
+	//! initialCharge is the charge at source, between 0 and maxCapacity.
+	chargingRoute run(unsigned source, unsigned target, int initialCharge) {
+		CORE_CH_SEARCH(ev_query_search);
+		assert(initialCharge >= 0 && initialCharge <= maxCapacity);
+		chargingRoute route = { inf_weight , 0 , vector<unsigned>() };
+		source = index->toInternal(source);
+		target = index->toInternal(target);
+		if (source == target) {
+			route.timeCost = 0;
+			route.arrivalCharge = initialCharge;
+			return route;
+		}
+
+		settledLabels = 0;
+		relaxedEdges = 0;
+		search(source, true);
+		search(target, false);
+
+		//without stop: every path meets both searches at a node, so all pairs of labels there are candidates
+		edgeConsumptionProfile initial = { 0 , maxCapacity , 0 };
+		edgeCost direct = { inf_weight , initial };
+		const vector<unsigned>& reached = forwardBags.getTouchedNodes();
+		for (unsigned i = 0; i < reached.size(); i++) {
+			forwardBags.forEachLabel(reached[i], [&](const edgeCost& first) {
+				backwardBags.forEachLabel(reached[i], [&](const edgeCost& second) {
+					improve(direct, combine(first, second), initialCharge);
+				});
+			});
+		}
+		if (direct.timeCost != inf_weight) {
+			route.timeCost = direct.timeCost;
+			route.arrivalCharge = arrivalCharge(direct.energyCost, initialCharge);
+		}
+
+		CORE_CH_COUNT_N(ev_query_search, settled_labels, settledLabels);
+		CORE_CH_COUNT_N(ev_query_search, relaxed_edges, relaxedEdges);
+
+		//with stops: Dijkstra on the available stations, every station is left with a full battery
+		CORE_CH_PHASE(ev_query_search, station_phase);
+		const unsigned stationNumber = station.size();
+		vector<unsigned> time(stationNumber, inf_weight);
+		vector<unsigned> parent(stationNumber, invalid_id);
+		vector<bool> done(stationNumber, false);
+		for (unsigned i = 0; i < stationNumber; i++) {
+			if (!available[i]) continue;
+			edgeCost firstLeg = legToStation(i, initialCharge);
+			if (firstLeg.timeCost != inf_weight)
+				time[i] = firstLeg.timeCost + chargingTime;
+		}
+
+		unsigned lastStop = invalid_id;
+		for (;;) {
+			unsigned u = invalid_id;
+			for (unsigned i = 0; i < stationNumber; i++) {
+				if (!done[i] && time[i] != inf_weight && (u == invalid_id || time[i] < time[u]))
+					u = i;
+			}
+			if (u == invalid_id || time[u] >= route.timeCost) break;
+			done[u] = true;
+
+			edgeCost toTarget = legFromStation(u);
+			if (toTarget.timeCost != inf_weight && time[u] + toTarget.timeCost < route.timeCost) {
+				route.timeCost = time[u] + toTarget.timeCost;
+				route.arrivalCharge = arrivalCharge(toTarget.energyCost, maxCapacity);
+				lastStop = u;
+			}
+			for (unsigned i = 0; i < stationNumber; i++) {
+				const edgeCost& leg = stationTable[u * stationNumber + i];
+				if (done[i] || !available[i] || leg.timeCost == inf_weight) continue;
+				if (time[u] + leg.timeCost + chargingTime < time[i]) {
+					time[i] = time[u] + leg.timeCost + chargingTime;
+					parent[i] = u;
+				}
+			}
+		}
+
+		for (unsigned u = lastStop; u != invalid_id; u = parent[u])
+			route.chargingStops.push_back(externalID[station[u]]);
+		reverse(route.chargingStops.begin(), route.chargingStops.end());
+		return route;
+	}
+
+	//! Search space of the last query: the labels settled and the edges relaxed by both searches.
+	unsigned getSettledLabels() const { return settledLabels; }
+	unsigned getRelaxedEdges() const { return relaxedEdges; }
+
+private:
+	static bool isFeasible(const edgeCost& cost, int charge) {
+		return cost.timeCost != inf_weight && cost.energyCost.in <= charge && cost.energyCost.in <= maxCapacity;
+	}
+
+	static int arrivalCharge(const edgeConsumptionProfile& profile, int charge) {
+		return min(profile.out, charge - profile.cost);
+	}
+
+	static edgeCost combine(const edgeCost& first, const edgeCost& second) {
+		return { first.timeCost + second.timeCost, edgeConsumptionProfileCombine(first.energyCost, second.energyCost) };
+	}
+
+	//! Replaces best by candidate if candidate is feasible with the start charge and faster, or as fast and arrives with more charge.
+	static void improve(edgeCost& best, const edgeCost& candidate, int charge) {
+		if (!isFeasible(candidate, charge)) return;
+		if (candidate.timeCost < best.timeCost
+			|| (candidate.timeCost == best.timeCost && arrivalCharge(candidate.energyCost, charge) > arrivalCharge(best.energyCost, charge)))
+			best = candidate;
+	}
+
+	//! Fastest leg from the start of the last forward search to station i that is feasible with the start charge,
+	//! timeCost inf_weight if there is none. Needs the search to have settled the whole core.
+	//! A station outside of the core is reached over its upward search space.
+	edgeCost legToStation(unsigned i, int charge) {
+		edgeConsumptionProfile initial = { 0 , maxCapacity , 0 };
+		edgeCost best = { inf_weight , initial };
+		if (index->getCore()[station[i]]) {
+			forwardBags.forEachLabel(station[i], [&](const edgeCost& cost) { improve(best, cost, charge); });
+			return best;
+		}
+		for (unsigned j = 0; j < toStation[i].size(); j++) {
+			const bucketLabel& label = toStation[i][j];
+			forwardBags.forEachLabel(label.node, [&](const edgeCost& cost) { improve(best, combine(cost, label.cost), charge); });
+		}
+		return best;
+	}
+
+	//! Fastest leg from station i with a full battery to the start of the last backward search.
+	edgeCost legFromStation(unsigned i) {
+		edgeConsumptionProfile initial = { 0 , maxCapacity , 0 };
+		edgeCost best = { inf_weight , initial };
+		if (index->getCore()[station[i]]) {
+			backwardBags.forEachLabel(station[i], [&](const edgeCost& cost) { improve(best, cost, maxCapacity); });
+			return best;
+		}
+		for (unsigned j = 0; j < fromStation[i].size(); j++) {
+			const bucketLabel& label = fromStation[i][j];
+			backwardBags.forEachLabel(label.node, [&](const edgeCost& cost) { improve(best, combine(label.cost, cost), maxCapacity); });
+		}
+		return best;
+	}
+
+	//! Stores the upward search spaces from and to station i, which lies outside of the core.
+	void collectSearchSpaces(unsigned i) {
+		upwardSearch(station[i], true);
+		upwardSearch(station[i], false);
+		const vector<unsigned>& forwardReached = forwardBags.getTouchedNodes();
+		for (unsigned k = 0; k < forwardReached.size(); k++) {
+			unsigned v = forwardReached[k];
+			forwardBags.forEachLabel(v, [&](const edgeCost& cost) { fromStation[i].push_back({ v, cost }); });
+		}
+		const vector<unsigned>& backwardReached = backwardBags.getTouchedNodes();
+		for (unsigned k = 0; k < backwardReached.size(); k++) {
+			unsigned v = backwardReached[k];
+			backwardBags.forEachLabel(v, [&](const edgeCost& cost) { toStation[i].push_back({ v, cost }); });
+		}
+	}
+
+	//! Label-setting search on the forward (or backward) graph from start, i.e., the upward search space plus the
+	//! whole core if the search reaches it.
+	void search(unsigned start, bool forward) {
+		labelSearch(start, forward, false);
+	}
+
+	//! As search, but core nodes are not left, so only the upward search space and the first core nodes get labels.
+	void upwardSearch(unsigned start, bool forward) {
+		labelSearch(start, forward, true);
+	}
+
+	//! Labels that need more than maxCapacity to start can not be part of any route and are dropped.
+	void labelSearch(unsigned start, bool forward, bool stopAtCore) {
+		const adjacencyGraphView& graph = forward ? index->getForwardGraph() : index->getBackwardGraph();
+		ParetoBags& bags = forward ? forwardBags : backwardBags;
+		edgeConsumptionProfile initial = { 0 , maxCapacity , 0 };
+		bags.clear();
+		bags.insert(start, { 0 , initial });
+
+		unsigned u;
+		edgeCost costU;
+		while (bags.pop(u, costU)) {
+			settledLabels++;
+			if (stopAtCore && index->getCore()[u]) continue;
+			FORALL_OUTGOING_EDGES(graph, u, e) {
+				relaxedEdges++;
+				edgeCost costV = { costU.timeCost + graph.getEdgeTime(e), edgeConsumptionProfile() };
+				//the backward search walks the path from its end, so the new edge comes first
+				if (forward)
+					costV.energyCost = edgeConsumptionProfileCombine(costU.energyCost, graph.getEdgeEnergy(e));
+				else
+					costV.energyCost = edgeConsumptionProfileCombine(graph.getEdgeEnergy(e), costU.energyCost);
+				if (costV.energyCost.in <= maxCapacity)
+					bags.insert(graph.getEdgeHead(e), costV);
+			}
+		}
+	}
+};
+
+#endif /* EVQUERY_H_ */
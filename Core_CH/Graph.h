@@ -4,6 +4,7 @@
 #include <algorithm>
 #include <cassert>
 #include <iostream>
+#include <stdexcept>
 #include <string>
 #include <vector>
 #include "constants.h"
@@ -11,7 +12,8 @@ using namespace std;
 
 #include "vector_io.h"
 
-#define FORALL_OUTGOING_EDGES(G, u, e) for(unsigned e = G.getFirstEdge(u); e <= G.getLastEdge(u); e++)
+//! Compares with one past the last edge, because the last edge of a vertex without edges is first - 1, which wraps around at 0.
+#define FORALL_OUTGOING_EDGES(G, u, e) for(unsigned e = G.getFirstEdge(u), e##_end = G.getLastEdge(u) + 1; e != e##_end; e++)
 #define FORALL_VERTICES(G, u) for(unsigned u = 0; u < G.vertexNumber(); u++)
 #define FORALL_EDGES(G, e) for(unsigned e = 0; e < G.edgeNumber(); e++)
 
@@ -84,7 +86,19 @@ edgeConsumptionProfile edgeConsumptionProfileCombine(edgeConsumptionProfile edge
 	return combinedEdge;
 }
 
-vector<edgeCost> weightGnerate(vector<unsigned> time, vector<int>energy)
+//! Whether a is at least as good as b in every criterion: not slower, needing no more charge to start,
+//! consuming no more and leaving at least as much charge from any start charge. Equal costs dominate each other.
+inline
+bool edgeCostDominates(const edgeCost& a, const edgeCost& b)
+{
+	return a.timeCost <= b.timeCost
+		&& a.energyCost.in <= b.energyCost.in
+		&& a.energyCost.cost <= b.energyCost.cost
+		&& a.energyCost.out >= b.energyCost.out;
+}
+
+template<class TimeVector, class EnergyVector>
+vector<edgeCost> weightGnerate(const TimeVector& time, const EnergyVector& energy)
 {
 	vector<edgeCost> temp(time.size());
 	for (unsigned i = 0; i < time.size(); ++i)
@@ -96,14 +110,110 @@ vector<edgeCost> weightGnerate(vector<unsigned> time, vector<int>energy)
 	return temp;
 }
 
+//! An energy profile as it is stored in the edge arrays: the three ints of edgeConsumptionProfile.
+struct wideConsumptionProfile
+{
+	int in;
+	int out;
+	int cost;
+
+	static wideConsumptionProfile pack(edgeConsumptionProfile p) { wideConsumptionProfile r = { p.in , p.out , p.cost }; return r; }
+	edgeConsumptionProfile unpack() const { edgeConsumptionProfile p = { in , out , cost }; return p; }
+};
+
+//! Stores in, maxCapacity - out and cost in 21 bits each, i.e., 8 instead of 12 bytes.
+//! Each of the three has to lie in [-2^20, 2^20), which holds for all profiles up to maxCapacity; otherwise pack throws.
+struct compactConsumptionProfile
+{
+	unsigned long long bits;
+
+	static compactConsumptionProfile pack(edgeConsumptionProfile p) {
+		compactConsumptionProfile r;
+		r.bits = field(p.in) | field((long long)maxCapacity - p.out) << fieldBits | field(p.cost) << (2 * fieldBits);
+		return r;
+	}
+
+	edgeConsumptionProfile unpack() const {
+		edgeConsumptionProfile p = { value(bits) , maxCapacity - value(bits >> fieldBits) , value(bits >> (2 * fieldBits)) };
+		return p;
+	}
+
+private:
+	static const unsigned fieldBits = 21;
+
+	static unsigned long long field(long long x) {
+		if (x < -(1ll << (fieldBits - 1)) || x >= (1ll << (fieldBits - 1)))
+			throw std::runtime_error("Energy profile does not fit into a compactConsumptionProfile.");
+		return (unsigned long long)x & ((1ull << fieldBits) - 1);
+	}
+
+	static int value(unsigned long long b) {
+		int x = b & ((1ull << fieldBits) - 1);
+		return x >= (1 << (fieldBits - 1)) ? x - (1 << fieldBits) : x;
+	}
+};
+
+//! Compile with -DCORE_CH_COMPACT_ENERGY to store the energy profiles of all graphs and index files packed.
+#ifdef CORE_CH_COMPACT_ENERGY
+typedef compactConsumptionProfile energyProfileStorage;
+#else
+typedef wideConsumptionProfile energyProfileStorage;
+#endif
+
+//! Edge weights as structure of arrays: the travel times in one array and the energy profiles in another,
+//! so that searches which only compare times do not load the profiles into the cache.
+template<class Profile = energyProfileStorage>
+class edgeCostArray {
+
+private:
+	vector<unsigned> time;
+	vector<Profile> energy;
+
+public:
+	edgeCostArray() { }
+
+	explicit edgeCostArray(size_t n) :
+		time(n),
+		energy(n, Profile::pack({ 0 , maxCapacity , 0 }))
+	{ }
+
+	explicit edgeCostArray(const vector<edgeCost>& weight) :
+		time(weight.size()),
+		energy(weight.size())
+	{
+		for (size_t e = 0; e < weight.size(); e++) set(e, weight[e]);
+	}
+
+	size_t size() const { return time.size(); }
+	void resize(size_t n) { time.resize(n); energy.resize(n, Profile::pack({ 0 , maxCapacity , 0 })); }
+
+	edgeCost operator[](size_t e) const { edgeCost w = { time[e] , energy[e].unpack() }; return w; }
+	unsigned getTime(size_t e) const { return time[e]; }
+	edgeConsumptionProfile getEnergy(size_t e) const { return energy[e].unpack(); }
+
+	void set(size_t e, edgeCost w) { time[e] = w.timeCost; energy[e] = Profile::pack(w.energyCost); }
+	void copy(size_t to, size_t from) { time[to] = time[from]; energy[to] = energy[from]; }
+
+	const unsigned* timeData() const { return time.data(); }
+	const Profile* energyData() const { return energy.data(); }
+
+	vector<edgeCost> toVector() const {
+		vector<edgeCost> weight(size());
+		for (size_t e = 0; e < size(); e++) weight[e] = (*this)[e];
+		return weight;
+	}
+
+	//! Bytes allocated for the weights.
+	unsigned long long memoryUsage() const { return time.capacity() * sizeof(unsigned) + energy.capacity() * sizeof(Profile); }
+};
+
 class adjacencyGraph {
 
 protected:
-	vector<unsigned> first_out;
-	vector<unsigned> head;
-	vector<edgeCost> weight;
-	vector<unsigned> time;
-	vector<int> energy;
+	//first_out and head are mapped when the graph is loaded from files, time and energy are only needed to compute the weight
+	mapped_vector<unsigned> first_out;
+	mapped_vector<unsigned> head;
+	edgeCostArray<> weight;
 
 public:
 	adjacencyGraph(const vector<unsigned> first_out, const vector<unsigned> head, const vector<edgeCost> weight) :
@@ -115,20 +225,14 @@ public:
 	adjacencyGraph(const unsigned vertexNumber, const unsigned edgeNumber) :
 		first_out(vertexNumber + 1),
 		head(edgeNumber),
-		time(edgeNumber),
-		energy(edgeNumber),
 		weight(edgeNumber)
 	{ }
 
 	adjacencyGraph(const string first_out_filename, const string head_filename, const string time_filename, const string energy_filename) :
-		first_out(load_vector<unsigned>(first_out_filename)),
-		head(load_vector<unsigned>(head_filename)),
-		time(load_vector<unsigned>(time_filename)),
-		energy(load_vector<int>(energy_filename))
-	{
-			weight = weightGnerate(time,energy);//
-
-		}
+		first_out(load_mapped_vector<unsigned>(first_out_filename, map_willneed)),
+		head(load_mapped_vector<unsigned>(head_filename, map_willneed)),
+		weight(weightGnerate(load_mapped_vector<unsigned>(time_filename, map_sequential), load_mapped_vector<int>(energy_filename, map_sequential)))
+	{ }
 
 	adjacencyGraph(const string folder_name) :
 //		adjacencyGraph(folder_name + "first_out", folder_name + "head", folder_name + "travel_time" , folder_name + "geo_distance")
@@ -138,8 +242,6 @@ public:
 	adjacencyGraph(const adjacencyGraph& g) :
 		first_out(g.first_out),
 		head(g.head),
-		time(g.time),
-		energy(g.energy),
 		weight(g.weight)
 	{ }
 
@@ -149,7 +251,8 @@ public:
 	
 	vector<unsigned> getFirstOut() const {return first_out;}
  	vector<unsigned> getHead() const { return head; }
-	vector<edgeCost> getWeight() const { return weight; }
+	vector<edgeCost> getWeight() const { return weight.toVector(); }
+	const edgeCostArray<>& getWeightArray() const { return weight; }
 
 	const unsigned vertexNumber() const { return first_out.size() - 1; }
 	const unsigned edgeNumber() const { return head.size(); }
@@ -159,6 +262,8 @@ public:
 	const unsigned outgoingEdgeNumber(unsigned u) const { assert(u < vertexNumber()); return first_out[u+1] - first_out[u]; }
 
 	const edgeCost getEdgeWeight(unsigned e) const { assert(e < edgeNumber()); return weight[e]; }
+	const unsigned getEdgeTime(unsigned e) const { assert(e < edgeNumber()); return weight.getTime(e); }
+	const edgeConsumptionProfile getEdgeEnergy(unsigned e) const { assert(e < edgeNumber()); return weight.getEnergy(e); }
 	const unsigned getEdgeHead(unsigned e) const { assert(e < edgeNumber()); return head[e]; }
 	const bool isValidEdge(unsigned e) const { assert(e < edgeNumber()); return true; }
 
@@ -172,28 +277,69 @@ public:
 		return -1;
 	}
 
-	void setEdgeWeight(unsigned e, edgeCost w) { assert(e < edgeNumber()); weight[e] = w; }
+	void setEdgeWeight(unsigned e, edgeCost w) { assert(e < edgeNumber()); weight.set(e, w); }
+};
+
+//! Read-only adjacency array over memory owned by someone else, e.g., a mapped index file.
+//! Offers the const interface of adjacencyGraph, so the FORALL macros work on it.
+class adjacencyGraphView {
+
+private:
+	const unsigned* first_out;
+	const unsigned* head;
+	const unsigned* time;
+	const energyProfileStorage* energy;
+	unsigned vertices;
+	unsigned edges;
+
+public:
+	adjacencyGraphView() :
+		first_out(NULL),
+		head(NULL),
+		time(NULL),
+		energy(NULL),
+		vertices(0),
+		edges(0)
+	{ }
+
+	adjacencyGraphView(const unsigned* first_out, const unsigned* head, const unsigned* time, const energyProfileStorage* energy, unsigned vertexNumber) :
+		first_out(first_out),
+		head(head),
+		time(time),
+		energy(energy),
+		vertices(vertexNumber),
+		edges(first_out[vertexNumber])
+	{ }
+
+	const unsigned vertexNumber() const { return vertices; }
+	const unsigned edgeNumber() const { return edges; }
+
+	const unsigned getFirstEdge(unsigned u) const { assert(u < vertexNumber()); return first_out[u]; }
+	const unsigned getLastEdge(unsigned u) const { assert(u < vertexNumber()); return first_out[u+1] - 1; }
+	const unsigned outgoingEdgeNumber(unsigned u) const { assert(u < vertexNumber()); return first_out[u+1] - first_out[u]; }
+
+	const edgeCost getEdgeWeight(unsigned e) const { assert(e < edgeNumber()); edgeCost w = { time[e] , energy[e].unpack() }; return w; }
+	const unsigned getEdgeTime(unsigned e) const { assert(e < edgeNumber()); return time[e]; }
+	const edgeConsumptionProfile getEdgeEnergy(unsigned e) const { assert(e < edgeNumber()); return energy[e].unpack(); }
+	const unsigned getEdgeHead(unsigned e) const { assert(e < edgeNumber()); return head[e]; }
+	const bool isValidEdge(unsigned e) const { assert(e < edgeNumber()); return true; }
 };
 
 class tailInformationGraph {
 
 private:
 	unsigned vertices;
-	vector<unsigned> tail;
-	vector<unsigned> head;
+	mapped_vector<unsigned> tail;
+	mapped_vector<unsigned> head;
 	vector<edgeCost> weight;
-	vector<unsigned> time;
-	vector<int> energy;
 
 public:
 	tailInformationGraph(const int vertices, const string tail_filename, const string head_filename, const string time_filename, const string energy_filename) :
 		vertices(vertices)
 	{
-		tail = load_vector<unsigned>(tail_filename);
-		head = load_vector<unsigned>(head_filename);
-		time = load_vector<unsigned>(time_filename);
-		energy = load_vector<int>(energy_filename);
-		weight = weightGnerate(time, energy);
+		tail = load_mapped_vector<unsigned>(tail_filename, map_willneed);
+		head = load_mapped_vector<unsigned>(head_filename, map_willneed);
+		weight = weightGnerate(load_mapped_vector<unsigned>(time_filename, map_sequential), load_mapped_vector<int>(energy_filename, map_sequential));
 	}
 
 	tailInformationGraph(const adjacencyGraph& g) :
@@ -211,7 +357,7 @@ public:
 
 	static tailInformationGraph reverse(tailInformationGraph& g) {
 		tailInformationGraph r = g;
-		r.tail.swap(r.head);
+		swap(r.tail, r.head);
 //		std::cout<<"here reverse"<<std::endl;
 		return r;
 	}
@@ -243,7 +389,7 @@ adjacencyGraph::adjacencyGraph(const tailInformationGraph& g) :
 	FORALL_EDGES((*this), e) {
 		outDegree[g.getEdgeTail(edgeOrder[e])]++;
 		head[e] = g.getEdgeHead(edgeOrder[e]);
-		weight[e] = g.getEdgeWeight(edgeOrder[e]);
+		weight.set(e, g.getEdgeWeight(edgeOrder[e]));
 	}
 
 	unsigned e = 0;
@@ -306,7 +452,7 @@ public:
 			first_out[v] = e;
 			FORALL_OUTGOING_EDGES(g, v, f) {
 				head[e] = g.getEdgeHead(f);
-				weight[e] = g.getEdgeWeight(f);
+				weight.set(e, g.getEdgeWeight(f));
 				is_valid[e] = true;
 				originalEdges[e] = 1;
 				e++;
@@ -361,6 +507,8 @@ public:
 		return edges;
 	}
 	const edgeCost getEdgeWeight(unsigned e) const { assert(e < edgeNumber()); assert(isValidEdge(e)); return weight[e]; }
+	const unsigned getEdgeTime(unsigned e) const { assert(e < edgeNumber()); assert(isValidEdge(e)); return weight.getTime(e); }
+	const edgeConsumptionProfile getEdgeEnergy(unsigned e) const { assert(e < edgeNumber()); assert(isValidEdge(e)); return weight.getEnergy(e); }
 	const unsigned getEdgeHead(unsigned e) const { assert(e < edgeNumber()); assert(isValidEdge(e)); return head[e]; }
 	const bool isValidEdge(unsigned e) const { assert(e < edgeNumber()); return is_valid[e]; }
 
@@ -382,7 +530,7 @@ public:
 		return edgeNumber;
 	}
 
-	void setEdgeWeight(unsigned e, edgeCost w) { assert(e < edgeNumber()); assert(isValidEdge(e)); weight[e] = w; }
+	void setEdgeWeight(unsigned e, edgeCost w) { assert(e < edgeNumber()); assert(isValidEdge(e)); weight.set(e, w); }
 
 	void deleteEdge(unsigned u, unsigned e) {
 		assert(u < vertexNumber());
@@ -396,7 +544,7 @@ public:
 		if (e != last) {
 			//Swap with last edge
 			head[e] = head[last];
-			weight[e] = weight[last];
+			weight.copy(e, last);
 			is_valid[e] = is_valid[last];
 			originalEdges[e] = originalEdges[last];
 		}
@@ -415,27 +563,45 @@ public:
 	void addEdge(unsigned u, unsigned v, edgeCost w, unsigned orig = 1) {
 		unsigned e = getEdge(u, v);
 		if (e != -1 && is_valid[e]) {
-			if (weight[e].timeCost > w.timeCost) {
-				weight[e] = w;
+			if (weight.getTime(e) > w.timeCost) {
+				weight.set(e, w);
 				originalEdges[e] = orig;
 			}
 			return;
 		}
+		appendEdge(u, v, w, orig);
+	}
 
+	//! Keeps parallel edges from u to v as long as none of them dominates another (see edgeCostDominates):
+	//! w is dropped if an edge dominates it, otherwise it replaces the edges it dominates or is added next to them.
+	void addNonDominatedEdge(unsigned u, unsigned v, edgeCost w, unsigned orig = 1) {
+		FORALL_OUTGOING_EDGES((*this), u, e) {
+			if (is_valid[e] && head[e] == v && edgeCostDominates(weight[e], w)) return;
+		}
+		//backwards, because deleteEdge moves the last edge into the deleted one
+		for (unsigned e = last_out[u] + 1; e-- > first_out[u];) {
+			if (is_valid[e] && head[e] == v && edgeCostDominates(w, weight[e]))
+				deleteEdge(u, e);
+		}
+		appendEdge(u, v, w, orig);
+	}
+
+private:
+	void appendEdge(unsigned u, unsigned v, edgeCost w, unsigned orig) {
 		//Look for space to the left and to the right of edge array.
 		unsigned last = last_out[u];
 		unsigned first = first_out[u];
 
 		if (last < edgeNumber() - 1 && !is_valid[last + 1]) {
 			head[last + 1] = v;
-			weight[last + 1] = w;
+			weight.set(last + 1, w);
 			is_valid[last + 1] = true;
 			originalEdges[last + 1] = orig;
 			last_out[u]++;
 		}
 		else if (first > 0 && !is_valid[first - 1]) {
 			head[first - 1] = v;
-			weight[first - 1] = w;
+			weight.set(first - 1, w);
 			is_valid[first - 1] = true;
 			originalEdges[first - 1] = orig;
 			first_out[u]--;
@@ -446,7 +612,7 @@ public:
 			is_valid.resize(edgeNumber() + 1);
 			originalEdges.resize(edgeNumber() + 1);
 			head[last + 1] = v;
-			weight[last + 1] = w;
+			weight.set(last + 1, w);
 			is_valid[last + 1] = true;
 			originalEdges[last + 1] = orig;
 			last_out[u]++;
@@ -461,14 +627,14 @@ public:
 			originalEdges.resize(newSize);
 			for (unsigned i = 0; i < outgoingEdgeNumber(u); i++) {
 				head[oldSize + i] = head[first_out[u] + i];
-				weight[oldSize + i] = weight[first_out[u] + i];
+				weight.copy(oldSize + i, first_out[u] + i);
 				is_valid[oldSize + i] = is_valid[first_out[u] + i];
 				originalEdges[oldSize + i] = originalEdges[first_out[u] + i];
 				is_valid[first_out[u] + i] = false;
 			}
 			unsigned lastElement = oldSize + outgoingEdgeNumber(u);
 			head[lastElement] = v;
-			weight[lastElement] = w;
+			weight.set(lastElement, w);
 			is_valid[lastElement] = true;
 			originalEdges[lastElement] = orig;
 			first_out[u] = oldSize;
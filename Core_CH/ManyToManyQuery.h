@@ -0,0 +1,153 @@
+#ifndef MANYTOMANYQUERY_H_
+#define MANYTOMANYQUERY_H_
+
+#include "CHQuery.h"
+
+struct bucketEntry
+{
+	unsigned target;
+	edgeCost cost;
+};
+
+//! Computes distance tables between many sources and many targets on a hierarchy.
+//! The backward upward searches of all targets store their labels in per-node buckets,
+//! then the forward upward search of every source scans the buckets of the nodes it settles.
+//! The index may have an uncontracted core as in CoreCHQuery; inside the core both searches use all core edges.
+//! Like CHQuery, the constructor taking the graph builds its own index, the one taking a shared index only
+//! allocates the per-query state.
+class ManyToManyQuery {
+
+private:
+	shared_ptr<const CHIndex> index;
+	DijkstraQueue queue;
+	vector<edgeCost> cost;
+	vector<unsigned> count;
+	vector<unsigned> settled;
+	unsigned runTime;
+	vector<unsigned> bucketFirst;
+	vector<bucketEntry> buckets;
+
+public:
+	//! The last coreSize nodes of order may form an uncontracted core.
+	ManyToManyQuery(const adjacencyGraph& graph, vector<unsigned>& order, unsigned coreSize = 0) :
+		ManyToManyQuery(make_shared<CHIndex>(graph, order, coreSize))
+	{ }
+
+	explicit ManyToManyQuery(shared_ptr<const CHIndex> index) :
+		index(index),
+		queue(index->vertexNumber()),
+		cost(index->vertexNumber()),
+		count(index->vertexNumber()),
+		runTime(0),
+		bucketFirst(index->vertexNumber() + 1)
+	{
+		for (unsigned i = 0; i < cost.size(); i++) {
+			edgeConsumptionProfile initial = {0 , maxCapacity , 0};
+			cost[i] = { inf_weight , initial };
+			count[i] = 0;
+		}
+	}
+
+	edgeCost getCost(unsigned i) {
+		if (runTime != count[i]) {
+			count[i] = runTime;
+			edgeConsumptionProfile initial = { 0 , maxCapacity , 0 };
+			cost[i] = { inf_weight , initial };
+		}
+		return cost[i];
+	}
+
+	//! Returns the sources.size() x targets.size() table in row-major order, i.e., the entry for
+	//! sources[i] and targets[j] is at i*targets.size()+j. Unreachable pairs have timeCost inf_weight.
+	vector<edgeCost> run(const vector<unsigned>& sources, const vector<unsigned>& targets) {
+		edgeConsumptionProfile initial = { 0 , maxCapacity , 0 };
+		vector<edgeCost> table(sources.size() * targets.size(), { inf_weight , initial });
+		CORE_CH_SEARCH(many_to_many_search);
+
+		fillBuckets(targets);
+
+		for (unsigned i = 0; i < sources.size(); i++) {
+			upwardSearch(index->getForwardGraph(), index->toInternal(sources[i]), true);
+			edgeCost* row = &table[i * targets.size()];
+			CORE_CH_PHASE(many_to_many_search, bucket_phase);
+			for (unsigned k = 0; k < settled.size(); k++) {
+				unsigned u = settled[k];
+				CORE_CH_COUNT_N(many_to_many_search, bucket_entries, bucketFirst[u+1] - bucketFirst[u]);
+				for (unsigned b = bucketFirst[u]; b < bucketFirst[u+1]; b++) {
+					const bucketEntry& entry = buckets[b];
+					if (cost[u].timeCost + entry.cost.timeCost < row[entry.target].timeCost) {
+						row[entry.target].timeCost = cost[u].timeCost + entry.cost.timeCost;
+						row[entry.target].energyCost = edgeConsumptionProfileCombine(cost[u].energyCost, entry.cost.energyCost);
+					}
+				}
+			}
+		}
+
+		return table;
+	}
+
+private:
+	//! Runs the backward search of every target and stores its labels grouped by node.
+	void fillBuckets(const vector<unsigned>& targets) {
+		vector<unsigned> bucketNode;
+		buckets.clear();
+		for (unsigned j = 0; j < targets.size(); j++) {
+			upwardSearch(index->getBackwardGraph(), index->toInternal(targets[j]), false);
+			for (unsigned k = 0; k < settled.size(); k++) {
+				bucketNode.push_back(settled[k]);
+				buckets.push_back({ j, cost[settled[k]] });
+			}
+		}
+
+		//counting sort by node
+		fill(bucketFirst.begin(), bucketFirst.end(), 0);
+		for (unsigned b = 0; b < bucketNode.size(); b++)
+			bucketFirst[bucketNode[b] + 1]++;
+		for (unsigned v = 0; v + 1 < bucketFirst.size(); v++)
+			bucketFirst[v + 1] += bucketFirst[v];
+		vector<unsigned> position(bucketFirst.begin(), bucketFirst.end() - 1);
+		vector<bucketEntry> sorted(buckets.size());
+		for (unsigned b = 0; b < bucketNode.size(); b++)
+			sorted[position[bucketNode[b]]++] = buckets[b];
+		buckets.swap(sorted);
+	}
+
+	//! Complete upward search from start. settled holds the reached nodes and cost their labels.
+	//! The forward search appends the edges to its label, the backward search prepends them.
+	void upwardSearch(const adjacencyGraphView& searchGraph, unsigned start, bool forward) {
+		runTime++;
+		queue.clear();
+		settled.clear();
+		edgeConsumptionProfile initial = { 0 , maxCapacity , 0 };
+		count[start] = runTime;
+		cost[start] = { 0 , initial };
+		queue.push({ start, cost[start] });
+
+		while (!queue.empty()) {
+			unsigned u = queue.pop().id;
+			settled.push_back(u);
+			CORE_CH_COUNT(many_to_many_search, settled_nodes);
+			edgeCost distanceU = cost[u];
+			FORALL_OUTGOING_EDGES(searchGraph, u, e) {
+				unsigned v = searchGraph.getEdgeHead(e);
+				CORE_CH_COUNT(many_to_many_search, relaxed_edges);
+				edgeCost distanceV = getCost(v);
+				if (distanceU.timeCost + searchGraph.getEdgeTime(e) < distanceV.timeCost) {
+					cost[v].timeCost = distanceU.timeCost + searchGraph.getEdgeTime(e);
+					if (forward)
+						cost[v].energyCost = edgeConsumptionProfileCombine(distanceU.energyCost, searchGraph.getEdgeEnergy(e));
+					else
+						cost[v].energyCost = edgeConsumptionProfileCombine(searchGraph.getEdgeEnergy(e), distanceU.energyCost);
+					if (queue.contains_id(v)) {
+						queue.decrease_key({ v, cost[v] });
+						CORE_CH_COUNT(many_to_many_search, decrease_keys);
+					}
+					else
+						queue.push({ v, cost[v] });
+				}
+			}
+		}
+	}
+};
+
+#endif /* MANYTOMANYQUERY_H_ */
@@ -0,0 +1,153 @@
+#ifndef PHASTQUERY_H_
+#define PHASTQUERY_H_
+
+#include "CHQuery.h"
+#if defined(__SSE4_1__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+//! One-to-all travel times with PHAST: a Dijkstra search from the source on the forward graph of the index,
+//! which settles the upward search space and, if the index has a core, the whole core, followed by one sweep
+//! over the remaining vertices in descending rank. Because the index is renumbered by rank, the sweep walks
+//! the IDs downward and pulls every distance over the downward edges, i.e., the backward graph, of the vertex.
+//! Up to lanes sources are processed together: their distances of a vertex lie next to each other, so the sweep
+//! relaxes an edge for all of them at once (with SSE4.1 or AVX2 if the compiler targets it).
+template<unsigned lanes = 8>
+class PHASTQuery {
+
+private:
+	shared_ptr<const CHIndex> index;
+	DijkstraQueue queue;
+	vector<unsigned> distance;
+	unsigned sourceNumber;
+
+public:
+	PHASTQuery(const adjacencyGraph& graph, vector<unsigned>& order, unsigned coreSize = 0) :
+		index(make_shared<CHIndex>(graph, order, coreSize)),
+		queue(graph.vertexNumber()),
+		distance(graph.vertexNumber() * lanes, inf_weight),
+		sourceNumber(0)
+	{ }
+
+	PHASTQuery(shared_ptr<const CHIndex> index) :
+		index(index),
+		queue(index->vertexNumber()),
+		distance(index->vertexNumber() * lanes, inf_weight),
+		sourceNumber(0)
+	{ }
+
+	//! Computes the distances from up to lanes sources.
+	void run(const unsigned* sources, unsigned number) {
+		CORE_CH_SEARCH(phast_search);
+		assert(number <= lanes);
+		sourceNumber = number;
+		fill(distance.begin(), distance.end(), inf_weight);
+		for (unsigned lane = 0; lane < number; lane++)
+			upwardSearch(index->toInternal(sources[lane]), lane);
+		sweep();
+	}
+
+	void run(unsigned source) { run(&source, 1); }
+
+	//! Travel time from the source of lane to v, inf_weight if v can not be reached.
+	unsigned getDistance(unsigned lane, unsigned v) const {
+		assert(lane < sourceNumber);
+		return distance[index->toInternal(v) * lanes + lane];
+	}
+
+	unsigned getDistance(unsigned v) const { return getDistance(0, v); }
+
+	//! Writes the travel times from the source of lane to all vertices in their original order.
+	void getDistances(unsigned lane, unsigned* result) const {
+		assert(lane < sourceNumber);
+		const unsigned* rank = index->getRank();
+		for (unsigned v = 0; v < index->vertexNumber(); v++)
+			result[v] = distance[rank[v] * lanes + lane];
+	}
+
+private:
+	void upwardSearch(unsigned source, unsigned lane) {
+		const adjacencyGraphView& forwardGraph = index->getForwardGraph();
+		edgeConsumptionProfile initial = { 0 , maxCapacity , 0 };
+		queue.clear();
+		distance[source * lanes + lane] = 0;
+		queue.push({ source, { 0 , initial } });
+		while (!queue.empty()) {
+			unsigned u = queue.pop().id;
+			unsigned distanceU = distance[u * lanes + lane];
+			CORE_CH_COUNT(phast_search, settled_nodes);
+			FORALL_OUTGOING_EDGES(forwardGraph, u, e) {
+				CORE_CH_COUNT(phast_search, relaxed_edges);
+				unsigned v = forwardGraph.getEdgeHead(e);
+				unsigned distanceV = distanceU + forwardGraph.getEdgeTime(e);
+				if (distanceV < distance[v * lanes + lane]) {
+					distance[v * lanes + lane] = distanceV;
+					if (queue.contains_id(v)) {
+						queue.decrease_key({ v, { distanceV , initial } });
+						CORE_CH_COUNT(phast_search, decrease_keys);
+					}
+					else
+						queue.push({ v, { distanceV , initial } });
+				}
+			}
+		}
+	}
+
+	//! The core vertices are final after the search. Every other vertex only has downward edges from
+	//! higher IDs left, whose tails are final when the vertex is reached.
+	void sweep() {
+		CORE_CH_PHASE(phast_search, sweep_phase);
+		const adjacencyGraphView& backwardGraph = index->getBackwardGraph();
+		const unsigned coreBegin = index->vertexNumber() - index->getCoreSize();
+		//the sweep relaxes every edge below the core once for all lanes
+		CORE_CH_COUNT_N(phast_search, relaxed_edges, coreBegin == 0 ? 0 : backwardGraph.getLastEdge(coreBegin - 1) + 1);
+		for (unsigned v = coreBegin; v-- > 0;) {
+			FORALL_OUTGOING_EDGES(backwardGraph, v, e)
+				relax(&distance[v * lanes], &distance[backwardGraph.getEdgeHead(e) * lanes], backwardGraph.getEdgeTime(e));
+		}
+	}
+
+	//! to[l] = min(to[l], from[l] + weight) for all lanes. inf_weight + weight does not overflow.
+	static void relax(unsigned* to, const unsigned* from, unsigned weight) {
+		unsigned l = 0;
+#ifdef __AVX2__
+		const __m256i w8 = _mm256_set1_epi32(weight);
+		for (; l + 8 <= lanes; l += 8) {
+			__m256i t = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(to + l));
+			__m256i f = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(from + l));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(to + l), _mm256_min_epu32(t, _mm256_add_epi32(f, w8)));
+		}
+#endif
+#ifdef __SSE4_1__
+		const __m128i w4 = _mm_set1_epi32(weight);
+		for (; l + 4 <= lanes; l += 4) {
+			__m128i t = _mm_loadu_si128(reinterpret_cast<const __m128i*>(to + l));
+			__m128i f = _mm_loadu_si128(reinterpret_cast<const __m128i*>(from + l));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(to + l), _mm_min_epu32(t, _mm_add_epi32(f, w4)));
+		}
+#endif
+		for (; l < lanes; l++)
+			to[l] = min(to[l], from[l] + weight);
+	}
+};
+
+//! Distance vectors from all sources, computed in batches of lanes sources by threadNumber threads that share the index.
+//! Row i, i.e., the entries from i*vertexNumber on, holds the travel times from sources[i] in the original vertex order.
+template<unsigned lanes>
+vector<unsigned> runPHAST(shared_ptr<const CHIndex> index, const vector<unsigned>& sources, unsigned threadNumber = 0) {
+	const unsigned n = index->vertexNumber();
+	threadNumber = get_thread_count(threadNumber);
+	vector<PHASTQuery<lanes> > queries(threadNumber, PHASTQuery<lanes>(index));
+	vector<unsigned> result((unsigned long long)sources.size() * n);
+	unsigned batchNumber = (sources.size() + lanes - 1) / lanes;
+	parallel_for(0, batchNumber, threadNumber, [&](unsigned batch, unsigned t) {
+		unsigned first = batch * lanes;
+		unsigned number = min<unsigned>(lanes, sources.size() - first);
+		queries[t].run(&sources[first], number);
+		for (unsigned lane = 0; lane < number; lane++)
+			queries[t].getDistances(lane, &result[(unsigned long long)(first + lane) * n]);
+	}, 1);
+	return result;
+}
+
+#endif /* PHASTQUERY_H_ */
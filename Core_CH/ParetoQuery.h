@@ -0,0 +1,299 @@
+#ifndef PARETOQUERY_H_
+#define PARETOQUERY_H_
+
+#include "CHQuery.h"
+#include <queue>
+#include <functional>
+#include <stdexcept>
+
+//! Pareto sets of time/energy labels for the nodes 0 to nodeNumber-1 and the queue that settles them in the order
+//! of their time. A node keeps at most maxLabels labels, invalid_id means no bound. A new label replaces the
+//! slowest one of a full set if it is faster and is dropped otherwise, so the fastest label always survives.
+//!
+//! Dominated and replaced labels free their slot, which the next label of the node reuses, so a set never has
+//! more slots than it once had labels. The queue refers to a slot together with its version, which a reuse
+//! increments, so references to freed slots are skipped when they are popped.
+class ParetoBags {
+
+private:
+	struct paretoLabel {
+		edgeCost cost;
+		unsigned version;
+		bool dead;
+	};
+
+	struct labelReference {
+		unsigned timeCost;
+		unsigned node;
+		unsigned label;
+		unsigned version;
+		bool operator>(const labelReference& other) const { return timeCost > other.timeCost; }
+	};
+
+	vector<vector<paretoLabel> > bag;
+	vector<unsigned> bagCount;
+	vector<unsigned> touched;
+	unsigned runTime;
+	unsigned maxLabels;
+	priority_queue<labelReference, vector<labelReference>, greater<labelReference> > queue;
+
+public:
+	ParetoBags(unsigned nodeNumber, unsigned maxLabels = invalid_id) :
+		bag(nodeNumber),
+		bagCount(nodeNumber, 0),
+		runTime(0),
+		maxLabels(maxLabels)
+	{
+		assert(maxLabels > 0);
+	}
+
+	//! Empties all sets and the queue.
+	void clear() {
+		runTime++;
+		touched.clear();
+		queue = priority_queue<labelReference, vector<labelReference>, greater<labelReference> >();
+	}
+
+	//! Adds the label to the set of v unless it is dominated or the set is full of faster labels.
+	bool insert(unsigned v, const edgeCost& cost) {
+		vector<paretoLabel>& labels = bag[v];
+		if (bagCount[v] != runTime) {
+			bagCount[v] = runTime;
+			labels.clear();
+			touched.push_back(v);
+		}
+		unsigned alive = 0;
+		unsigned slowest = invalid_id;
+		for (unsigned i = 0; i < labels.size(); i++) {
+			if (labels[i].dead) continue;
+			if (edgeCostDominates(labels[i].cost, cost)) return false;
+			alive++;
+		}
+		unsigned slot = invalid_id;
+		for (unsigned i = 0; i < labels.size(); i++) {
+			if (!labels[i].dead && edgeCostDominates(cost, labels[i].cost)) {
+				labels[i].dead = true;
+				alive--;
+			}
+			if (labels[i].dead)
+				slot = i;
+			else if (slowest == invalid_id || labels[i].cost.timeCost > labels[slowest].cost.timeCost)
+				slowest = i;
+		}
+		if (alive >= maxLabels) {
+			if (labels[slowest].cost.timeCost <= cost.timeCost) return false;
+			labels[slowest].dead = true;
+			slot = slowest;
+		}
+		if (slot == invalid_id) {
+			slot = labels.size();
+			labels.push_back({ cost, 0, false });
+		}
+		else {
+			labels[slot].cost = cost;
+			labels[slot].version++;
+			labels[slot].dead = false;
+		}
+		queue.push({ cost.timeCost, v, slot, labels[slot].version });
+		return true;
+	}
+
+	//! Takes the fastest label that is still in its set from the queue. Returns false once the queue is empty.
+	bool pop(unsigned& v, edgeCost& cost) {
+		while (!queue.empty()) {
+			labelReference reference = queue.top();
+			queue.pop();
+			const paretoLabel& label = bag[reference.node][reference.label];
+			if (label.dead || label.version != reference.version) continue;
+			v = reference.node;
+			cost = label.cost;
+			return true;
+		}
+		return false;
+	}
+
+	//! The nodes that got a label since the last clear, in the order of their first label.
+	const vector<unsigned>& getTouchedNodes() const { return touched; }
+
+	//! Calls f(cost) for every label in the set of v.
+	template<class F>
+	void forEachLabel(unsigned v, const F& f) const {
+		if (bagCount[v] != runTime) return;
+		const vector<paretoLabel>& labels = bag[v];
+		for (unsigned i = 0; i < labels.size(); i++) {
+			if (!labels[i].dead)
+				f(labels[i].cost);
+		}
+	}
+};
+
+//! All non-dominated trade-offs between travel time and energy (see edgeCostDominates) from source to target.
+//! Plain Dijkstra searches from both ends climb the upward search spaces and stop at the core. Only inside the
+//! core every node holds a Pareto set of labels, which starts with the fastest paths from the source to the core
+//! entries. A label-setting search settles the labels in the order of their time and combines them with the
+//! backward labels at the core exits. So the set is complete between core nodes, e.g., charging stations, while
+//! the parts outside of the core are the fastest paths to and from the core.
+//!
+//! The index must keep the trade-offs between core nodes (see CHIndex::keepsTradeOffs): time-only witnesses
+//! drop slower but cheaper shortcuts between core nodes, so the constructor rejects such an index.
+//!
+//! The sets are ParetoBags bounded by maxLabels, so a small bound trades some of the slower trade-offs for speed.
+//! Labels that need more than maxCapacity to start are dropped as well.
+class ParetoQuery : public QueryContext {
+
+private:
+	shared_ptr<const CHIndex> index;
+	unsigned coreBegin;
+	ParetoBags bags;
+	vector<unsigned> coreEntries;
+	vector<edgeCost> result;
+	unsigned settledLabels;
+
+public:
+	ParetoQuery(shared_ptr<const CHIndex> index, unsigned maxLabels = 16) :
+		QueryContext(index->vertexNumber()),
+		index(index),
+		coreBegin(index->vertexNumber() - index->getCoreSize()),
+		bags(index->getCoreSize(), maxLabels),
+		settledLabels(0)
+	{
+		if (!index->keepsTradeOffs())
+			throw std::invalid_argument("ParetoQuery needs a hierarchy contracted with energy aware witnesses.");
+	}
+
+	//! The trade-offs from source to target, sorted by time.
+	//! Empty if target can not be reached.
+	const vector<edgeCost>& run(unsigned source, unsigned target) {
+		CORE_CH_SEARCH(pareto_query_search);
+		source = index->toInternal(source);
+		target = index->toInternal(target);
+		runTime++;
+		settledNodes = 0;
+		relaxedEdges = 0;
+		settledLabels = 0;
+		result.clear();
+		bags.clear();
+		edgeConsumptionProfile initial = { 0 , maxCapacity , 0 };
+		if (source == target) {
+			result.push_back({ 0 , initial });
+			return result;
+		}
+
+		upwardSearch(target, false);
+		upwardSearch(source, true);
+
+		//the label sets of the core are seeded with the fastest paths to the core entries
+		CORE_CH_PHASE(pareto_query_search, core_phase);
+		CORE_CH_COUNT_N(pareto_query_search, core_entries, coreEntries.size());
+		for (unsigned i = 0; i < coreEntries.size(); i++) {
+			unsigned v = coreEntries[i];
+			insertLabel(v, forwardCost[v]);
+		}
+
+		const adjacencyGraphView& forwardGraph = index->getForwardGraph();
+		unsigned u;
+		edgeCost costU;
+		while (bags.pop(u, costU)) {
+			u += coreBegin;
+			settledLabels++;
+			if (getBackwardCost(u).timeCost != inf_weight)
+				insertResult(combine(costU, backwardCost[u]));
+
+			//edges of core nodes stay in the core
+			FORALL_OUTGOING_EDGES(forwardGraph, u, e) {
+				relaxedEdges++;
+				edgeCost costV = { costU.timeCost + forwardGraph.getEdgeTime(e), edgeConsumptionProfileCombine(costU.energyCost, forwardGraph.getEdgeEnergy(e)) };
+				insertLabel(forwardGraph.getEdgeHead(e), costV);
+			}
+		}
+		CORE_CH_COUNT_N(pareto_query_search, settled_nodes, settledNodes);
+		CORE_CH_COUNT_N(pareto_query_search, settled_labels, settledLabels);
+		CORE_CH_COUNT_N(pareto_query_search, relaxed_edges, relaxedEdges);
+
+		sort(result.begin(), result.end(), [](const edgeCost& a, const edgeCost& b) {
+			return a.timeCost < b.timeCost || (a.timeCost == b.timeCost && a.energyCost.cost < b.energyCost.cost);
+		});
+		return result;
+	}
+
+	//! Labels settled in the core by the last query. getSettledNodes counts the nodes of the upward searches.
+	unsigned getSettledLabels() const { return settledLabels; }
+
+private:
+	static edgeCost combine(const edgeCost& first, const edgeCost& second) {
+		return { first.timeCost + second.timeCost, edgeConsumptionProfileCombine(first.energyCost, second.energyCost) };
+	}
+
+	static bool isFeasible(const edgeCost& cost) {
+		return cost.energyCost.in <= maxCapacity;
+	}
+
+	//! Dijkstra on the forward (or backward) graph that does not leave the core nodes it reaches.
+	//! The forward search collects the core entries and the non-core meeting nodes, whose paths are candidates.
+	void upwardSearch(unsigned start, bool forward) {
+		const adjacencyGraphView& graph = forward ? index->getForwardGraph() : index->getBackwardGraph();
+		DijkstraQueue& queue = forward ? forwardQueue : backwardQueue;
+		vector<edgeCost>& cost = forward ? forwardCost : backwardCost;
+		vector<unsigned>& count = forward ? forwardCount : backwardCount;
+		edgeConsumptionProfile initial = { 0 , maxCapacity , 0 };
+		coreEntries.clear();
+		queue.clear();
+		count[start] = runTime;
+		cost[start] = { 0 , initial };
+		queue.push({ start, cost[start] });
+
+		while (!queue.empty()) {
+			unsigned u = queue.pop().id;
+			settledNodes++;
+			if (u >= coreBegin) {
+				if (forward) coreEntries.push_back(u);
+				continue;
+			}
+			if (forward && getBackwardCost(u).timeCost != inf_weight)
+				insertResult(combine(forwardCost[u], backwardCost[u]));
+			edgeCost distanceU = cost[u];
+			FORALL_OUTGOING_EDGES(graph, u, e) {
+				unsigned v = graph.getEdgeHead(e);
+				relaxedEdges++;
+				if (count[v] != runTime) {
+					count[v] = runTime;
+					cost[v] = { inf_weight , initial };
+				}
+				if (distanceU.timeCost + graph.getEdgeTime(e) < cost[v].timeCost) {
+					cost[v].timeCost = distanceU.timeCost + graph.getEdgeTime(e);
+					//the backward search walks the path from its end, so the new edge comes first
+					if (forward)
+						cost[v].energyCost = edgeConsumptionProfileCombine(distanceU.energyCost, graph.getEdgeEnergy(e));
+					else
+						cost[v].energyCost = edgeConsumptionProfileCombine(graph.getEdgeEnergy(e), distanceU.energyCost);
+					if (queue.contains_id(v))
+						queue.decrease_key({ v, cost[v] });
+					else
+						queue.push({ v, cost[v] });
+				}
+			}
+		}
+	}
+
+	//! Adds the label to the set of the core node v.
+	void insertLabel(unsigned v, const edgeCost& cost) {
+		if (isFeasible(cost))
+			bags.insert(v - coreBegin, cost);
+	}
+
+	void insertResult(const edgeCost& cost) {
+		if (!isFeasible(cost)) return;
+		for (unsigned i = 0; i < result.size(); i++) {
+			if (edgeCostDominates(result[i], cost)) return;
+		}
+		unsigned kept = 0;
+		for (unsigned i = 0; i < result.size(); i++) {
+			if (!edgeCostDominates(cost, result[i]))
+				result[kept++] = result[i];
+		}
+		result.resize(kept);
+		result.push_back(cost);
+	}
+};
+
+#endif /* PARETOQUERY_H_ */
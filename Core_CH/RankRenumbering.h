@@ -0,0 +1,93 @@
+#ifndef RANKRENUMBERING_H_
+#define RANKRENUMBERING_H_
+
+#include "Graph.h"
+
+//! Renumbers the vertices of a hierarchy so that the ID of a vertex is its rank in the contraction order.
+//! Upward searches then move towards higher IDs, and the core, which consists of the highest ranks,
+//! is one contiguous block at the end of every vertex array. IDs seen by users are called external,
+//! the IDs after renumbering internal; queries translate them at their interface.
+class RankRenumbering {
+
+private:
+	vector<unsigned> internal;
+	vector<unsigned> external;
+
+public:
+	explicit RankRenumbering(const vector<unsigned>& order) :
+		internal(order.size()),
+		external(order)
+	{
+		for (unsigned i = 0; i < order.size(); i++) {
+			assert(order[i] < order.size());
+			internal[order[i]] = i;
+		}
+	}
+
+	const unsigned vertexNumber() const { return internal.size(); }
+	unsigned toInternal(unsigned v) const { assert(v < vertexNumber()); return internal[v]; }
+	unsigned toExternal(unsigned v) const { assert(v < vertexNumber()); return external[v]; }
+
+	//! internal[v] is the rank of the external vertex v, external[i] the i-th vertex of the order.
+	const vector<unsigned>& getInternalIDs() const { return internal; }
+	const vector<unsigned>& getExternalIDs() const { return external; }
+
+	//! The graph with internal IDs. The outgoing edges of a vertex keep their relative order.
+	adjacencyGraph permuteGraph(const adjacencyGraph& g) const {
+		assert(g.vertexNumber() == vertexNumber());
+		vector<unsigned> first_out(vertexNumber() + 1);
+		vector<unsigned> head(g.edgeNumber());
+		vector<edgeCost> weight(g.edgeNumber());
+
+		unsigned edgeIndex = 0;
+		for (unsigned u = 0; u < vertexNumber(); u++) {
+			first_out[u] = edgeIndex;
+			FORALL_OUTGOING_EDGES(g, external[u], e) {
+				head[edgeIndex] = internal[g.getEdgeHead(e)];
+				weight[edgeIndex] = g.getEdgeWeight(e);
+				edgeIndex++;
+			}
+		}
+		first_out[vertexNumber()] = edgeIndex;
+
+		return adjacencyGraph(first_out, head, weight);
+	}
+
+	//! Reorders per-vertex data such as coordinates or charging station flags from external to internal IDs.
+	template<class T>
+	vector<T> permuteVertexData(const vector<T>& data) const {
+		assert(data.size() == vertexNumber());
+		vector<T> result(data.size());
+		for (unsigned v = 0; v < vertexNumber(); v++)
+			result[internal[v]] = data[v];
+		return result;
+	}
+};
+
+//! The edges of a graph with internal IDs that an upward search may use: those leading to a higher ID and,
+//! inside the core formed by the last coreSize IDs, all edges between core vertices. Applied to the reversed
+//! graph, it gives the graph of the backward search. Queries on these graphs need no check per edge.
+inline
+adjacencyGraph upwardGraph(const adjacencyGraph& g, unsigned coreSize) {
+	assert(coreSize <= g.vertexNumber());
+	const unsigned coreBegin = g.vertexNumber() - coreSize;
+	vector<unsigned> first_out(g.vertexNumber() + 1);
+	vector<unsigned> head;
+	vector<edgeCost> weight;
+
+	FORALL_VERTICES(g, u) {
+		first_out[u] = head.size();
+		FORALL_OUTGOING_EDGES(g, u, e) {
+			unsigned v = g.getEdgeHead(e);
+			if (v > u || (u >= coreBegin && v >= coreBegin)) {
+				head.push_back(v);
+				weight.push_back(g.getEdgeWeight(e));
+			}
+		}
+	}
+	first_out[g.vertexNumber()] = head.size();
+
+	return adjacencyGraph(first_out, head, weight);
+}
+
+#endif /* RANKRENUMBERING_H_ */
@@ -83,7 +83,7 @@ private:
 	overheadGraph backwardSearchGraph;
 	vector<unsigned> level;
 	vector<unsigned> order;
-	WitnessSearch witnessSearch;
+	SimpleWitnessSearch witnessSearch;
 
 public:
 	SimpleContractionBuilder(adjacencyGraph& graph, vector<unsigned> order) :
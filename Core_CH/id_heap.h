@@ -0,0 +1,236 @@
+#ifndef ID_HEAP_H
+#define ID_HEAP_H
+
+#include "constants.h"
+#include <vector>
+#include <algorithm>
+#include <cassert>
+#if defined(__SSE4_1__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+//! A priority queue where the elements are IDs from 0 to id_count-1 where id_count is a number that is set in the constructor.
+//! Pair is a struct with the members id and key. The elements are sorted by the unsigned integer that KeyProjection
+//! extracts from the key, the smallest first. The heap only moves these integers and the IDs, which are stored in two
+//! separate arrays, while the full keys stay at their ID. If the compiler targets SSE4.1 or AVX2 (e.g. -march=native),
+//! the smallest of 4 or 8 children is found with one vector comparison.
+template<class Pair, class KeyProjection, unsigned tree_arity = 4>
+class MinIDHeap{
+public:
+	typedef decltype(Pair::key) key_type;
+
+	MinIDHeap():heap_size(0){}
+
+	explicit MinIDHeap(unsigned id_count):
+		id_pos(id_count, invalid_id),
+		id_key(id_count),
+		heap_key(id_count),
+		heap_id(id_count),
+		heap_size(0){}
+
+	//! Returns whether the queue is empty. Equivalent to checking whether size() returns 0.
+	bool empty()const{
+		return heap_size == 0;
+	}
+
+	//! Returns the number of elements in the queue.
+	unsigned size()const{
+		return heap_size;
+	}
+
+	//! Returns the id_count value passed to the constructor.
+	unsigned id_count()const{
+		return id_pos.size();
+	}
+
+	//! Checks whether an element is in the queue.
+	bool contains_id(unsigned id)const{
+		assert(id < id_count());
+		return id_pos[id] != invalid_id;
+	}
+
+	//! Removes all elements from the queue.
+	void clear(){
+		for(unsigned i=0; i<heap_size; ++i)
+			id_pos[heap_id[i]] = invalid_id;
+		heap_size = 0;
+	}
+
+	friend void swap(MinIDHeap&l, MinIDHeap&r){
+		using std::swap;
+		swap(l.id_pos, r.id_pos);
+		swap(l.id_key, r.id_key);
+		swap(l.heap_key, r.heap_key);
+		swap(l.heap_id, r.heap_id);
+		swap(l.heap_size, r.heap_size);
+	}
+
+	//! Returns the current key of an element.
+	//! Undefined if the element is not part of the queue.
+	key_type get_key(unsigned id)const{
+		assert(id < id_count());
+		assert(id_pos[id] != invalid_id);
+		return id_key[id];
+	}
+
+	//! Returns the smallest element key pair without removing it from the queue.
+	Pair peek()const{
+		assert(!empty());
+		Pair p;
+		p.id = heap_id[0];
+		p.key = id_key[p.id];
+		return p;
+	}
+
+	//! Returns the smallest element key pair and removes it form the queue.
+	Pair pop(){
+		Pair p = peek();
+		--heap_size;
+		id_pos[p.id] = invalid_id;
+		if(heap_size != 0){
+			heap_key[0] = heap_key[heap_size];
+			heap_id[0] = heap_id[heap_size];
+			id_pos[heap_id[0]] = 0;
+			move_down_in_tree(0);
+		}
+		return p;
+	}
+
+	//! Inserts a element key pair.
+	//! Undefined if the element is part of the queue.
+	void push(Pair p){
+		assert(p.id < id_count());
+		assert(!contains_id(p.id));
+
+		unsigned pos = heap_size;
+		++heap_size;
+		id_key[p.id] = p.key;
+		heap_key[pos] = project(p.key);
+		heap_id[pos] = p.id;
+		id_pos[p.id] = pos;
+		move_up_in_tree(pos);
+	}
+
+	//! Updates the key of an element if the new key is smaller than the old key.
+	//! Does nothing if the new key is larger.
+	//! Undefined if the element is not part of the queue.
+	bool decrease_key(Pair p){
+		assert(p.id < id_count());
+		assert(contains_id(p.id));
+
+		unsigned pos = id_pos[p.id];
+		unsigned key = project(p.key);
+
+		if(heap_key[pos] > key){
+			id_key[p.id] = p.key;
+			heap_key[pos] = key;
+			move_up_in_tree(pos);
+			return true;
+		} else {
+			return false;
+		}
+	}
+
+	//! Updates the key of an element if the new key is larger than the old key.
+	//! Does nothing if the new key is smaller.
+	//! Undefined if the element is not part of the queue.
+	bool increase_key(Pair p){
+		assert(p.id < id_count());
+		assert(contains_id(p.id));
+
+		unsigned pos = id_pos[p.id];
+		unsigned key = project(p.key);
+
+		if(heap_key[pos] < key){
+			id_key[p.id] = p.key;
+			heap_key[pos] = key;
+			move_down_in_tree(pos);
+			return true;
+		} else {
+			return false;
+		}
+	}
+
+private:
+	static unsigned project(const key_type&key){
+		return KeyProjection()(key);
+	}
+
+	void move_up_in_tree(unsigned pos){
+		unsigned key = heap_key[pos];
+		unsigned id = heap_id[pos];
+		while(pos != 0){
+			unsigned parent = (pos-1)/tree_arity;
+			if(heap_key[parent] <= key)
+				break;
+			heap_key[pos] = heap_key[parent];
+			heap_id[pos] = heap_id[parent];
+			id_pos[heap_id[pos]] = pos;
+			pos = parent;
+		}
+		heap_key[pos] = key;
+		heap_id[pos] = id;
+		id_pos[id] = pos;
+	}
+
+	void move_down_in_tree(unsigned pos){
+		unsigned key = heap_key[pos];
+		unsigned id = heap_id[pos];
+		for(;;){
+			unsigned first_child = tree_arity*pos+1;
+			if(first_child >= heap_size)
+				break; // no children
+			unsigned smallest_child = get_smallest_child(first_child);
+			if(heap_key[smallest_child] >= key)
+				break; // no child is smaller
+
+			heap_key[pos] = heap_key[smallest_child];
+			heap_id[pos] = heap_id[smallest_child];
+			id_pos[heap_id[pos]] = pos;
+			pos = smallest_child;
+		}
+		heap_key[pos] = key;
+		heap_id[pos] = id;
+		id_pos[id] = pos;
+	}
+
+	//! The first of the children with the smallest key, as in a scan from left to right.
+	unsigned get_smallest_child(unsigned first_child)const{
+		const unsigned end = std::min(first_child+tree_arity, heap_size);
+#ifdef __SSE4_1__
+		if(tree_arity == 4 && end == first_child+4){
+			__m128i k = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&heap_key[first_child]));
+			__m128i m = _mm_min_epu32(k, _mm_shuffle_epi32(k, _MM_SHUFFLE(2, 3, 0, 1)));
+			m = _mm_min_epu32(m, _mm_shuffle_epi32(m, _MM_SHUFFLE(1, 0, 3, 2)));
+			unsigned mask = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(k, m)));
+			return first_child + __builtin_ctz(mask);
+		}
+#endif
+#ifdef __AVX2__
+		if(tree_arity == 8 && end == first_child+8){
+			__m256i k = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&heap_key[first_child]));
+			__m256i m = _mm256_min_epu32(k, _mm256_permute2x128_si256(k, k, 1));
+			m = _mm256_min_epu32(m, _mm256_shuffle_epi32(m, _MM_SHUFFLE(1, 0, 3, 2)));
+			m = _mm256_min_epu32(m, _mm256_shuffle_epi32(m, _MM_SHUFFLE(2, 3, 0, 1)));
+			unsigned mask = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(k, m)));
+			return first_child + __builtin_ctz(mask);
+		}
+#endif
+		unsigned smallest_child = first_child;
+		for(unsigned c = first_child+1; c < end; ++c){
+			if(heap_key[smallest_child] > heap_key[c]){
+				smallest_child = c;
+			}
+		}
+		return smallest_child;
+	}
+
+	std::vector<unsigned>id_pos;
+	std::vector<key_type>id_key;
+	std::vector<unsigned>heap_key;
+	std::vector<unsigned>heap_id;
+
+	unsigned heap_size;
+};
+
+#endif
@@ -0,0 +1,204 @@
+#ifndef INSTRUMENTATION_H
+#define INSTRUMENTATION_H
+
+#include "timer.h"
+#include <ostream>
+
+//! The searches, counters and phases the instrumentation distinguishes. A new search only needs a new entry.
+enum instrumented_search { ch_query_search, core_ch_query_search, many_to_many_search, witness_search, pareto_query_search, ev_query_search, phast_search, instrumented_search_count };
+enum instrumented_counter { settled_nodes, relaxed_edges, decrease_keys, stalled_nodes, core_entries, bucket_entries, settled_labels, instrumented_counter_count };
+//! search_phase is the whole search, the others are the parts of it that are timed on their own.
+enum instrumented_phase { search_phase, stall_phase, core_phase, bucket_phase, station_phase, sweep_phase, instrumented_phase_count };
+
+//! Compile with -DCORE_CH_INSTRUMENTATION to count and time the searches. Otherwise the macros expand to nothing.
+//! CORE_CH_SEARCH(search) opens a search until the end of the scope: it times the search and afterwards adds its
+//! counters and phase times to the histograms. CORE_CH_PHASE(search, phase) times the rest of its scope,
+//! CORE_CH_COUNT(search, counter) and CORE_CH_COUNT_N(search, counter, n) count for the open search.
+//! Every thread has its own counters, dump_instrumentation merges them. It must not run while a search runs.
+#ifdef CORE_CH_INSTRUMENTATION
+
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+//! Counts per search in buckets of powers of two: bucket 0 holds the zeros, bucket b the values in [2^(b-1), 2^b).
+struct instrumentation_histogram {
+	unsigned long long bucket[65];
+	unsigned long long count;
+	unsigned long long sum;
+	unsigned long long max;
+
+	void add(unsigned long long value) {
+		bucket[value == 0 ? 0 : 64 - __builtin_clzll(value)]++;
+		count++;
+		sum += value;
+		if (value > max) max = value;
+	}
+
+	void merge(const instrumentation_histogram& other) {
+		for (unsigned b = 0; b < 65; b++)
+			bucket[b] += other.bucket[b];
+		count += other.count;
+		sum += other.sum;
+		if (other.max > max) max = other.max;
+	}
+
+	//! Upper bound of the q-quantile: the largest value of the bucket it falls into, at most the maximum.
+	unsigned long long quantile(double q) const {
+		unsigned long long seen = 0;
+		for (unsigned b = 0; b < 65; b++) {
+			seen += bucket[b];
+			if (seen > 0 && seen >= q * count)
+				return b == 0 ? 0 : (b == 64 ? max : std::min((1ull << b) - 1, max));
+		}
+		return max;
+	}
+};
+
+struct thread_instrumentation {
+	unsigned long long current_count[instrumented_search_count][instrumented_counter_count];
+	unsigned long long current_cycles[instrumented_search_count][instrumented_phase_count];
+	instrumentation_histogram counters[instrumented_search_count][instrumented_counter_count];
+	instrumentation_histogram phases[instrumented_search_count][instrumented_phase_count];
+
+	void finish(instrumented_search search) {
+		for (unsigned c = 0; c < instrumented_counter_count; c++) {
+			counters[search][c].add(current_count[search][c]);
+			current_count[search][c] = 0;
+		}
+		for (unsigned p = 0; p < instrumented_phase_count; p++) {
+			phases[search][p].add(current_cycles[search][p]);
+			current_cycles[search][p] = 0;
+		}
+	}
+};
+
+struct instrumentation_registry {
+	std::mutex mutex;
+	std::vector<std::unique_ptr<thread_instrumentation> > threads;
+};
+
+inline
+instrumentation_registry& get_instrumentation_registry(){
+	static instrumentation_registry registry;
+	return registry;
+}
+
+//! The counters of the calling thread. They are owned by the registry, so they outlive the thread and still count in the dump.
+inline
+thread_instrumentation& get_thread_instrumentation(){
+	static thread_local thread_instrumentation* record = nullptr;
+	if (record == nullptr) {
+		instrumentation_registry& registry = get_instrumentation_registry();
+		std::lock_guard<std::mutex> lock(registry.mutex);
+		registry.threads.emplace_back(new thread_instrumentation());
+		record = registry.threads.back().get();
+	}
+	return *record;
+}
+
+class instrumentation_phase_timer {
+	unsigned long long& cycles;
+	unsigned long long begin;
+public:
+	instrumentation_phase_timer(instrumented_search search, instrumented_phase phase) :
+		cycles(get_thread_instrumentation().current_cycles[search][phase]),
+		begin(get_cycle_count())
+	{ }
+	~instrumentation_phase_timer() { cycles += get_cycle_count() - begin; }
+};
+
+class instrumentation_search_scope {
+	instrumented_search search;
+	unsigned long long begin;
+public:
+	explicit instrumentation_search_scope(instrumented_search search) : search(search), begin(get_cycle_count()) { }
+	~instrumentation_search_scope() {
+		thread_instrumentation& record = get_thread_instrumentation();
+		record.current_cycles[search][search_phase] += get_cycle_count() - begin;
+		record.finish(search);
+	}
+};
+
+#define CORE_CH_INSTRUMENTATION_NAME2(name, line) name##line
+#define CORE_CH_INSTRUMENTATION_NAME(name, line) CORE_CH_INSTRUMENTATION_NAME2(name, line)
+#define CORE_CH_SEARCH(search) instrumentation_search_scope CORE_CH_INSTRUMENTATION_NAME(instrumentation_search_, __LINE__)(search)
+#define CORE_CH_PHASE(search, phase) instrumentation_phase_timer CORE_CH_INSTRUMENTATION_NAME(instrumentation_phase_, __LINE__)(search, phase)
+#define CORE_CH_COUNT_N(search, counter, n) (get_thread_instrumentation().current_count[search][counter] += (n))
+#define CORE_CH_COUNT(search, counter) CORE_CH_COUNT_N(search, counter, 1)
+
+//! Writes the counters and phase times of every search that ran since the last reset: mean, quantiles and maximum
+//! per search and, if histograms is set, the non-empty buckets. Counters and phases that stayed zero are left out.
+inline
+void dump_instrumentation(std::ostream& out, bool histograms = false){
+	static const char* search_name[] = { "CHQuery", "CoreCHQuery", "ManyToManyQuery", "WitnessSearch", "ParetoQuery", "EVQuery", "PHASTQuery" };
+	static const char* counter_name[] = { "settled nodes", "relaxed edges", "decrease keys", "stalled nodes", "core entries", "bucket entries", "settled labels" };
+	static const char* phase_name[] = { "search", "stall-on-demand", "core", "buckets", "station table", "sweep" };
+	instrumentation_registry& registry = get_instrumentation_registry();
+	std::lock_guard<std::mutex> lock(registry.mutex);
+	double cycles_per_micro_second = get_cycles_per_micro_second();
+
+	for (unsigned s = 0; s < instrumented_search_count; s++) {
+		instrumentation_histogram counters[instrumented_counter_count] = {};
+		instrumentation_histogram phases[instrumented_phase_count] = {};
+		for (unsigned t = 0; t < registry.threads.size(); t++) {
+			for (unsigned c = 0; c < instrumented_counter_count; c++)
+				counters[c].merge(registry.threads[t]->counters[s][c]);
+			for (unsigned p = 0; p < instrumented_phase_count; p++)
+				phases[p].merge(registry.threads[t]->phases[s][p]);
+		}
+		unsigned long long searches = phases[search_phase].count;
+		if (searches == 0) continue;
+
+		out << search_name[s] << ": " << searches << " searches on " << registry.threads.size() << " threads" << std::endl;
+		for (unsigned i = 0; i < instrumented_counter_count + instrumented_phase_count; i++) {
+			bool is_phase = i >= instrumented_counter_count;
+			const instrumentation_histogram& h = is_phase ? phases[i - instrumented_counter_count] : counters[i];
+			if (h.sum == 0) continue;
+			out << "	" << (is_phase ? phase_name[i - instrumented_counter_count] : counter_name[i]) << (is_phase ? " cycles" : "")
+				<< ": total " << h.sum << ", mean " << (double)h.sum / h.count
+				<< ", p50 <= " << h.quantile(0.5) << ", p90 <= " << h.quantile(0.9) << ", p99 <= " << h.quantile(0.99)
+				<< ", max " << h.max;
+			if (is_phase)
+				out << " (mean " << (double)h.sum / h.count / cycles_per_micro_second << " us)";
+			out << std::endl;
+			if (!histograms) continue;
+			for (unsigned b = 0; b < 65; b++) {
+				if (h.bucket[b] == 0) continue;
+				out << "		";
+				if (b == 0) out << "0";
+				else out << "[" << (1ull << (b - 1)) << ", " << (b == 64 ? h.max : (1ull << b) - 1) << "]";
+				out << ": " << h.bucket[b] << std::endl;
+			}
+		}
+	}
+}
+
+//! Clears the counters of all threads. Like dump_instrumentation it must not run while a search runs.
+inline
+void reset_instrumentation(){
+	instrumentation_registry& registry = get_instrumentation_registry();
+	std::lock_guard<std::mutex> lock(registry.mutex);
+	for (unsigned t = 0; t < registry.threads.size(); t++)
+		*registry.threads[t] = thread_instrumentation();
+}
+
+#else
+
+#define CORE_CH_SEARCH(search) ((void)0)
+#define CORE_CH_PHASE(search, phase) ((void)0)
+#define CORE_CH_COUNT_N(search, counter, n) ((void)0)
+#define CORE_CH_COUNT(search, counter) ((void)0)
+
+inline
+void dump_instrumentation(std::ostream& out, bool /*histograms*/ = false){
+	out << "instrumentation is compiled out, compile with -DCORE_CH_INSTRUMENTATION" << std::endl;
+}
+
+inline
+void reset_instrumentation(){ }
+
+#endif
+
+#endif
@@ -0,0 +1,77 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <string>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+//! Hints for MappedFile, can be combined with |.
+//! map_populate reads the whole file while mapping it (MAP_POPULATE, Linux only),
+//! the others are passed to madvise and only influence the read-ahead of the kernel.
+const unsigned map_populate = 1;
+const unsigned map_sequential = 2;
+const unsigned map_random = 4;
+const unsigned map_willneed = 8;
+
+//! A file mapped read-only into memory. The mapping lives as long as the object.
+class MappedFile{
+public:
+	explicit MappedFile(const std::string&file_name, unsigned hints = 0):
+		begin(0), file_size(0){
+		int fd = open(file_name.c_str(), O_RDONLY);
+		if(fd == -1)
+			throw std::runtime_error("Can not open \""+file_name+"\" for reading.");
+		struct stat info;
+		if(fstat(fd, &info) == -1){
+			close(fd);
+			throw std::runtime_error("Can not determine the size of \""+file_name+"\".");
+		}
+		file_size = info.st_size;
+		if(file_size != 0){
+			int flags = MAP_SHARED;
+#ifdef MAP_POPULATE
+			if(hints & map_populate)
+				flags |= MAP_POPULATE;
+#endif
+			void*p = mmap(0, file_size, PROT_READ, flags, fd, 0);
+			if(p == MAP_FAILED){
+				close(fd);
+				throw std::runtime_error("Can not map \""+file_name+"\" into memory.");
+			}
+			begin = static_cast<const char*>(p);
+			if(hints & map_sequential)
+				madvise(p, file_size, MADV_SEQUENTIAL);
+			if(hints & map_random)
+				madvise(p, file_size, MADV_RANDOM);
+			if(hints & map_willneed)
+				madvise(p, file_size, MADV_WILLNEED);
+		}
+		close(fd);
+	}
+
+	~MappedFile(){
+		if(begin != 0)
+			munmap(const_cast<char*>(begin), file_size);
+	}
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile&operator=(const MappedFile&) = delete;
+
+	//! The first byte of the file. mmap aligns it to a page.
+	const char*data()const{
+		return begin;
+	}
+
+	unsigned long long size()const{
+		return file_size;
+	}
+
+private:
+	const char*begin;
+	unsigned long long file_size;
+};
+
+#endif
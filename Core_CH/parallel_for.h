@@ -0,0 +1,52 @@
+#ifndef PARALLEL_FOR_H
+#define PARALLEL_FOR_H
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+//! Returns the number of threads to use if the caller passed 0, i.e., the number of cores.
+inline
+unsigned get_thread_count(unsigned thread_count){
+	if(thread_count != 0)
+		return thread_count;
+	unsigned cores = std::thread::hardware_concurrency();
+	return cores == 0 ? 1 : cores;
+}
+
+//! Calls f(i, thread_id) for every i in [begin, end) using thread_count threads.
+//! The indices are handed out dynamically in blocks of chunk_size, so f may take different amounts of time per index.
+//! thread_id is in [0, thread_count) and can be used to index per-thread state.
+template<class F>
+void parallel_for(unsigned begin, unsigned end, unsigned thread_count, const F&f, unsigned chunk_size = 64){
+	if(begin >= end)
+		return;
+	thread_count = std::min(get_thread_count(thread_count), (end - begin + chunk_size - 1) / chunk_size);
+	if(thread_count <= 1){
+		for(unsigned i=begin; i<end; ++i)
+			f(i, 0u);
+		return;
+	}
+
+	std::atomic<unsigned>next(begin);
+	auto work = [&](unsigned thread_id){
+		for(;;){
+			unsigned first = next.fetch_add(chunk_size);
+			if(first >= end)
+				return;
+			unsigned last = std::min(end, first + chunk_size);
+			for(unsigned i=first; i<last; ++i)
+				f(i, thread_id);
+		}
+	};
+
+	std::vector<std::thread>threads;
+	for(unsigned t=1; t<thread_count; ++t)
+		threads.emplace_back(work, t);
+	work(0);
+	for(auto&t:threads)
+		t.join();
+}
+
+#endif
@@ -0,0 +1,172 @@
+// Contracts a graph with ContractionBuilder for a range of core sizes on both metrics and compares the
+// hierarchies with the reference hierarchies shipped in <metric>_ch/: preprocessing time, peak memory,
+// shortcuts, edges in the core and the query time on the test queries.
+// The reference is queried with its own order and CHQuery, so the query times show how good our order is.
+// Build: g++ -O2 -DNDEBUG -march=native preprocessingBenchmark.cpp -o PreprocessingBenchmark -std=c++11 -pthread
+// Usage: ./PreprocessingBenchmark [graph folder] [core sizes, e.g. 0,1000,10000] [threads, 1 for run()] [number of queries] [JSON output file]
+
+#include "CHQuery.h"
+#include "CoreCHQuery.h"
+#include "ContractionBuilder.h"
+#include "Graph.h"
+#include "vector_io.h"
+#include "timer.h"
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <iostream>
+using namespace std;
+
+//! One hierarchy: ours for a core size or the reference (coreSize 0, no preprocessing measured).
+struct preprocessingResult {
+	string metric;
+	string hierarchy;
+	unsigned coreSize;
+	double preprocessingTime;
+	unsigned long long peakMemory;
+	unsigned shortcuts;
+	unsigned edgesInCore;
+	unsigned edges;
+	unsigned queries;
+	unsigned wrong;
+	double queryTime;
+	double settledNodes;
+};
+
+//! The largest resident set size of the process since the last resetPeakMemory in kB, 0 if /proc is not available.
+unsigned long long getPeakMemory() {
+	ifstream status("/proc/self/status");
+	string line;
+	while (getline(status, line)) {
+		if (line.compare(0, 6, "VmHWM:") == 0)
+			return strtoull(line.c_str() + 6, NULL, 10);
+	}
+	return 0;
+}
+
+//! Sets the peak to the current resident set size, so each contraction gets its own peak.
+void resetPeakMemory() {
+	ofstream clear("/proc/self/clear_refs");
+	clear << "5";
+}
+
+//! Answers the test queries and adds the mean query time, the mean search space and the wrong answers to result.
+template<class Query>
+void measureQueries(Query& query, const vector<unsigned>& source, const vector<unsigned>& target, const vector<unsigned>& length, unsigned queryNumber, preprocessingResult& result) {
+	unsigned long long settled = 0;
+	result.queries = queryNumber;
+	result.wrong = 0;
+	long long begin = get_micro_time();
+	for (unsigned i = 0; i < queryNumber; i++) {
+		if (query.run(source[i], target[i]).timeCost != length[i])
+			result.wrong++;
+		settled += query.getSettledNodes();
+	}
+	result.queryTime = queryNumber == 0 ? 0 : (double)(get_micro_time() - begin) / queryNumber;
+	result.settledNodes = queryNumber == 0 ? 0 : (double)settled / queryNumber;
+}
+
+void printText(const preprocessingResult& r) {
+	cout << r.metric << " " << r.hierarchy;
+	if (r.hierarchy != "reference") cout << " core " << r.coreSize;
+	cout << ":";
+	if (r.hierarchy != "reference")
+		cout << " " << r.preprocessingTime / 1000000 << " s, peak " << r.peakMemory / 1024 << " MB,";
+	cout << " " << r.shortcuts << " shortcuts, " << r.edgesInCore << " edges in core, " << r.edges << " edges" << endl;
+	cout << "	" << r.queries << " queries, " << r.wrong << " wrong, " << r.queryTime << " us/query, " << r.settledNodes << " settled nodes" << endl;
+}
+
+string toJSON(const string& graphFolder, const vector<preprocessingResult>& results) {
+	ostringstream out;
+	out << "{\n  \"graph\": \"" << graphFolder << "\",\n  \"results\": [";
+	for (unsigned i = 0; i < results.size(); i++) {
+		const preprocessingResult& r = results[i];
+		out << (i == 0 ? "\n" : ",\n")
+			<< "    {\"metric\": \"" << r.metric << "\", \"hierarchy\": \"" << r.hierarchy << "\""
+			<< ", \"core_size\": " << r.coreSize
+			<< ", \"preprocessing_time_us\": " << r.preprocessingTime << ", \"peak_rss_kb\": " << r.peakMemory
+			<< ", \"shortcuts\": " << r.shortcuts << ", \"edges_in_core\": " << r.edgesInCore << ", \"edges\": " << r.edges
+			<< ", \"queries\": " << r.queries << ", \"wrong\": " << r.wrong
+			<< ", \"query_time_us\": " << r.queryTime << ", \"settled_nodes\": " << r.settledNodes << "}";
+	}
+	out << "\n  ]\n}\n";
+	return out.str();
+}
+
+void benchmarkMetric(const string& graph_folder, const string& metric, const vector<unsigned>& coreSizes, unsigned threads, unsigned queryNumber, vector<preprocessingResult>& results) {
+	adjacencyGraph graph(graph_folder + "first_out", graph_folder + "head", graph_folder + metric, graph_folder + "geo_distance");
+	vector<unsigned> source = load_vector<unsigned>(graph_folder + "test/source");
+	vector<unsigned> target = load_vector<unsigned>(graph_folder + "test/target");
+	vector<unsigned> length = load_vector<unsigned>(graph_folder + "test/" + metric + "_length");
+	queryNumber = min<unsigned>(queryNumber, source.size());
+	vector<bool> chargingStation(graph.vertexNumber(), false);
+
+	for (unsigned i = 0; i < coreSizes.size(); i++) {
+		preprocessingResult result = preprocessingResult();
+		result.metric = metric;
+		result.hierarchy = "contraction";
+		result.coreSize = coreSizes[i];
+		resetPeakMemory();
+		long long begin = get_micro_time();
+		ContractionBuilder builder(graph, chargingStation);
+		builder.getTelemetry().setSummary(0, NULL);
+		if (threads == 1)
+			builder.run(coreSizes[i]);
+		else
+			builder.runParallel(coreSizes[i], threads);
+		result.preprocessingTime = get_micro_time() - begin;
+		result.peakMemory = getPeakMemory();
+		result.shortcuts = builder.getShortcutNumber();
+		result.edgesInCore = builder.getEdgesInCore();
+
+		adjacencyGraph augmented = builder.getAugmentedGraph();
+		vector<unsigned> order = builder.getOrder();
+		result.edges = augmented.edgeNumber();
+		if (builder.getCoreSize() == 0) {
+			CHQuery query(augmented, order);
+			measureQueries(query, source, target, length, queryNumber, result);
+		}
+		else {
+			CoreCHQuery query(augmented, order, builder.getCoreSize());
+			measureQueries(query, source, target, length, queryNumber, result);
+		}
+		results.push_back(result);
+		printText(result);
+	}
+
+	preprocessingResult reference = preprocessingResult();
+	reference.metric = metric;
+	reference.hierarchy = "reference";
+	vector<unsigned> order;
+	adjacencyGraph ch = loadReferenceCH(graph_folder + metric + "_ch/", order);
+	reference.edges = ch.edgeNumber();
+	reference.shortcuts = ch.edgeNumber() - graph.edgeNumber();
+	reference.edgesInCore = 0;
+	CHQuery query(ch, order);
+	measureQueries(query, source, target, length, queryNumber, reference);
+	results.push_back(reference);
+	printText(reference);
+}
+
+int main(int argc, char** argv) {
+	string graph_folder = argc > 1 ? argv[1] : "./graph/karlsruhe/";
+	vector<unsigned> coreSizes;
+	istringstream sizes(argc > 2 ? argv[2] : "0,1000,10000");
+	for (string size; getline(sizes, size, ',');)
+		coreSizes.push_back(atoi(size.c_str()));
+	unsigned threads = argc > 3 ? atoi(argv[3]) : 1;
+	unsigned queryNumber = argc > 4 ? atoi(argv[4]) : 10000;
+
+	vector<preprocessingResult> results;
+	benchmarkMetric(graph_folder, "travel_time", coreSizes, threads, queryNumber, results);
+	benchmarkMetric(graph_folder, "geo_distance", coreSizes, threads, queryNumber, results);
+
+	if (argc > 5) {
+		ofstream json(argv[5]);
+		json << toJSON(graph_folder, results);
+		cout << "JSON written to " << argv[5] << endl;
+	}
+	return 0;
+}
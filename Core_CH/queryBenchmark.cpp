@@ -0,0 +1,218 @@
+// Runs the test queries of a graph with Dijkstra, bidirectional Dijkstra and CHQuery on both metrics,
+// checks every result against the test/*_length reference and reports throughput, latency and search space.
+// CHQuery uses the hierarchy shipped with the graph in <metric>_ch/.
+// Build: g++ -O2 -DNDEBUG -march=native queryBenchmark.cpp -o QueryBenchmark -std=c++11 -pthread
+// With -DCORE_CH_INSTRUMENTATION the counters and phase times of the CH queries are dumped at the end.
+// Usage: ./QueryBenchmark [graph folder] [number of queries, 0 for all, default 1000] [JSON output file]
+
+#include "CHQuery.h"
+#include "Graph.h"
+#include "vector_io.h"
+#include "timer.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <iostream>
+using namespace std;
+
+//! Dijkstra on one graph. Only the distances touched by the last search are reset, so a short query does not pay for the whole graph.
+class DijkstraSearch {
+
+private:
+	const adjacencyGraph& graph;
+	DijkstraQueue queue;
+	vector<unsigned> distance;
+	vector<unsigned> touched;
+
+public:
+	unsigned settledNodes;
+	unsigned relaxedEdges;
+
+	explicit DijkstraSearch(const adjacencyGraph& graph) :
+		graph(graph),
+		queue(graph.vertexNumber()),
+		distance(graph.vertexNumber(), inf_weight),
+		settledNodes(0),
+		relaxedEdges(0)
+	{ }
+
+	void start(unsigned source) {
+		for (unsigned i = 0; i < touched.size(); i++)
+			distance[touched[i]] = inf_weight;
+		touched.clear();
+		queue.clear();
+		settledNodes = 0;
+		relaxedEdges = 0;
+		setDistance(source, 0);
+	}
+
+	bool empty() { return queue.empty(); }
+	unsigned minimum() { return queue.peek().key.timeCost; }
+	unsigned getDistance(unsigned v) const { return distance[v]; }
+
+	//! Settles the next node and returns it.
+	//! With the search of the opposite direction, every relaxed edge that reaches one of its nodes is a candidate for best.
+	unsigned step(const DijkstraSearch* other = nullptr, unsigned* best = nullptr) {
+		unsigned u = queue.pop().id;
+		settledNodes++;
+		FORALL_OUTGOING_EDGES(graph, u, e) {
+			relaxedEdges++;
+			unsigned v = graph.getEdgeHead(e);
+			unsigned distanceV = distance[u] + graph.getEdgeTime(e);
+			if (other && other->distance[v] != inf_weight)
+				*best = min(*best, distanceV + other->distance[v]);
+			if (distanceV < distance[v])
+				setDistance(v, distanceV);
+		}
+		return u;
+	}
+
+private:
+	void setDistance(unsigned v, unsigned d) {
+		edgeConsumptionProfile initial = { 0 , maxCapacity , 0 };
+		if (distance[v] == inf_weight) touched.push_back(v);
+		distance[v] = d;
+		if (queue.contains_id(v))
+			queue.decrease_key({ v, { d , initial } });
+		else
+			queue.push({ v, { d , initial } });
+	}
+};
+
+//! The measurements of one algorithm on one metric.
+struct benchmarkResult {
+	string metric;
+	string algorithm;
+	unsigned queries;
+	unsigned wrong;
+	double totalTime;
+	vector<double> latency;
+	double settledNodes;
+	double relaxedEdges;
+
+	double percentile(double p) const {
+		if (latency.empty()) return 0;
+		return latency[min<size_t>(latency.size() - 1, (size_t)(p * latency.size()))];
+	}
+};
+
+//! Runs query(i) for all test queries. query returns the travel time and adds its search space to settled and relaxed.
+//! The latency of each query is taken from steady_clock, as microseconds get_micro_time is too coarse for CH queries.
+template<class Query>
+benchmarkResult benchmark(const string& metric, const string& algorithm, const vector<unsigned>& length, unsigned queryNumber, Query query) {
+	benchmarkResult result = { metric, algorithm, queryNumber, 0, 0, vector<double>(queryNumber), 0, 0 };
+	unsigned long long settled = 0;
+	unsigned long long relaxed = 0;
+	long long begin = get_micro_time();
+	for (unsigned i = 0; i < queryNumber; i++) {
+		chrono::steady_clock::time_point queryBegin = chrono::steady_clock::now();
+		unsigned distance = query(i, settled, relaxed);
+		result.latency[i] = chrono::duration<double, micro>(chrono::steady_clock::now() - queryBegin).count();
+		if (distance != length[i]) result.wrong++;
+	}
+	result.totalTime = get_micro_time() - begin;
+	sort(result.latency.begin(), result.latency.end());
+	result.settledNodes = queryNumber == 0 ? 0 : (double)settled / queryNumber;
+	result.relaxedEdges = queryNumber == 0 ? 0 : (double)relaxed / queryNumber;
+	return result;
+}
+
+void printText(const benchmarkResult& r) {
+	cout << r.metric << " " << r.algorithm << ": " << r.queries << " queries, " << r.wrong << " wrong, "
+		<< (r.totalTime == 0 ? 0 : r.queries / (r.totalTime / 1000000)) << " queries/s" << endl;
+	cout << "	latency (us): p50 " << r.percentile(0.5) << ", p90 " << r.percentile(0.9)
+		<< ", p99 " << r.percentile(0.99) << ", max " << (r.latency.empty() ? 0 : r.latency.back()) << endl;
+	cout << "	settled nodes " << r.settledNodes << ", relaxed edges " << r.relaxedEdges << " (mean per query)" << endl;
+}
+
+string toJSON(const string& graphFolder, const vector<benchmarkResult>& results) {
+	ostringstream out;
+	out << "{\n  \"graph\": \"" << graphFolder << "\",\n  \"results\": [";
+	for (unsigned i = 0; i < results.size(); i++) {
+		const benchmarkResult& r = results[i];
+		out << (i == 0 ? "\n" : ",\n")
+			<< "    {\"metric\": \"" << r.metric << "\", \"algorithm\": \"" << r.algorithm << "\""
+			<< ", \"queries\": " << r.queries << ", \"wrong\": " << r.wrong
+			<< ", \"total_time_us\": " << r.totalTime
+			<< ", \"queries_per_second\": " << (r.totalTime == 0 ? 0 : r.queries / (r.totalTime / 1000000))
+			<< ", \"latency_us\": {\"p50\": " << r.percentile(0.5) << ", \"p90\": " << r.percentile(0.9)
+			<< ", \"p99\": " << r.percentile(0.99) << ", \"max\": " << (r.latency.empty() ? 0 : r.latency.back()) << "}"
+			<< ", \"settled_nodes\": " << r.settledNodes << ", \"relaxed_edges\": " << r.relaxedEdges << "}";
+	}
+	out << "\n  ]\n}\n";
+	return out.str();
+}
+
+void benchmarkMetric(const string& graph_folder, const string& metric, unsigned queryNumber, vector<benchmarkResult>& results) {
+	adjacencyGraph graph(graph_folder + "first_out", graph_folder + "head", graph_folder + metric, graph_folder + "geo_distance");
+	adjacencyGraph reverseGraph = adjacencyGraph::reverse(graph);
+	vector<unsigned> source = load_vector<unsigned>(graph_folder + "test/source");
+	vector<unsigned> target = load_vector<unsigned>(graph_folder + "test/target");
+	vector<unsigned> length = load_vector<unsigned>(graph_folder + "test/" + metric + "_length");
+	queryNumber = queryNumber == 0 ? source.size() : min<unsigned>(queryNumber, source.size());
+
+	DijkstraSearch forward(graph);
+	DijkstraSearch backward(reverseGraph);
+	results.push_back(benchmark(metric, "dijkstra", length, queryNumber, [&](unsigned i, unsigned long long& settled, unsigned long long& relaxed) {
+		forward.start(source[i]);
+		while (!forward.empty() && forward.step() != target[i]) {}
+		settled += forward.settledNodes;
+		relaxed += forward.relaxedEdges;
+		return forward.getDistance(target[i]);
+	}));
+	printText(results.back());
+
+	//alternates between the directions by the smaller minimum and stops once both minima sum up to the best path over a meeting edge
+	results.push_back(benchmark(metric, "bidirectional dijkstra", length, queryNumber, [&](unsigned i, unsigned long long& settled, unsigned long long& relaxed) {
+		forward.start(source[i]);
+		backward.start(target[i]);
+		unsigned best = source[i] == target[i] ? 0 : inf_weight;
+		while (!forward.empty() && !backward.empty() && forward.minimum() + backward.minimum() < best) {
+			if (forward.minimum() <= backward.minimum())
+				forward.step(&backward, &best);
+			else
+				backward.step(&forward, &best);
+		}
+		settled += forward.settledNodes + backward.settledNodes;
+		relaxed += forward.relaxedEdges + backward.relaxedEdges;
+		return best;
+	}));
+	printText(results.back());
+
+	vector<unsigned> order;
+	adjacencyGraph ch = loadReferenceCH(graph_folder + metric + "_ch/", order);
+	CHQuery query(ch, order);
+	results.push_back(benchmark(metric, "ch", length, queryNumber, [&](unsigned i, unsigned long long& settled, unsigned long long& relaxed) {
+		unsigned distance = query.run(source[i], target[i]).timeCost;
+		settled += query.getSettledNodes();
+		relaxed += query.getRelaxedEdges();
+		return distance;
+	}));
+	printText(results.back());
+}
+
+int main(int argc, char** argv) {
+	string graph_folder = argc > 1 ? argv[1] : "./graph/karlsruhe/";
+	unsigned queryNumber = argc > 2 ? atoi(argv[2]) : 1000;
+
+	vector<benchmarkResult> results;
+	benchmarkMetric(graph_folder, "travel_time", queryNumber, results);
+	benchmarkMetric(graph_folder, "geo_distance", queryNumber, results);
+#ifdef CORE_CH_INSTRUMENTATION
+	dump_instrumentation(cout);
+#endif
+
+	if (argc > 3) {
+		ofstream json(argv[3]);
+		json << toJSON(graph_folder, results);
+		cout << "JSON written to " << argv[3] << endl;
+	}
+
+	unsigned wrong = 0;
+	for (unsigned i = 0; i < results.size(); i++)
+		wrong += results[i].wrong;
+	return wrong == 0 ? 0 : 1;
+}
@@ -0,0 +1,85 @@
+// Compares the priority queues of the Dijkstra searches on the test queries of a graph.
+// Build: g++ -O2 -DNDEBUG -march=native queueBenchmark.cpp -o QueueBenchmark -std=c++11
+// Usage: ./QueueBenchmark [graph folder] [number of queries]
+
+#include "Graph.h"
+#include "id_queue.h"
+#include "radix_queue.h"
+#include "vector_io.h"
+#include "timer.h"
+#include <cstdlib>
+#include <string>
+#include <iostream>
+using namespace std;
+
+//! Plain Dijkstra from source, stopped when target is settled. Without a target it settles the whole graph.
+template<class Queue>
+unsigned dijkstra(const adjacencyGraph& graph, Queue& queue, vector<unsigned>& distance, unsigned source, unsigned target, unsigned& settled) {
+	queue.clear();
+	fill(distance.begin(), distance.end(), inf_weight);
+	edgeConsumptionProfile initial = { 0 , maxCapacity , 0 };
+	distance[source] = 0;
+	queue.push({ source, { 0 , initial } });
+	while (!queue.empty()) {
+		unsigned u = queue.pop().id;
+		settled++;
+		if (u == target) break;
+		FORALL_OUTGOING_EDGES(graph, u, e) {
+			unsigned v = graph.getEdgeHead(e);
+			unsigned distanceV = distance[u] + graph.getEdgeTime(e);
+			if (distanceV < distance[v]) {
+				distance[v] = distanceV;
+				if (queue.contains_id(v))
+					queue.decrease_key({ v, { distanceV , initial } });
+				else
+					queue.push({ v, { distanceV , initial } });
+			}
+		}
+	}
+	return target == invalid_id ? 0 : distance[target];
+}
+
+template<class Queue>
+void benchmark(const string& name, const adjacencyGraph& graph, const vector<unsigned>& source, const vector<unsigned>& target, const vector<unsigned>& length, unsigned queryNumber) {
+	Queue queue(graph.vertexNumber());
+	vector<unsigned> distance(graph.vertexNumber());
+
+	unsigned wrong = 0;
+	unsigned settled = 0;
+	long long begin = get_micro_time();
+	for (unsigned i = 0; i < queryNumber; i++) {
+		if (dijkstra(graph, queue, distance, source[i], target[i], settled) != length[i])
+			wrong++;
+	}
+	long long pointToPoint = get_micro_time() - begin;
+
+	unsigned oneToAllNumber = max(1u, queryNumber / 10);
+	begin = get_micro_time();
+	for (unsigned i = 0; i < oneToAllNumber; i++)
+		dijkstra(graph, queue, distance, source[i], invalid_id, settled);
+	long long oneToAll = get_micro_time() - begin;
+
+	cout << name << ": point-to-point " << (double)pointToPoint / queryNumber << " us/query"
+		<< ", one-to-all " << (double)oneToAll / oneToAllNumber << " us/query"
+		<< ", settled " << settled << ", wrong " << wrong << endl;
+}
+
+int main(int argc, char** argv) {
+	string graph_folder = argc > 1 ? argv[1] : "./graph/karlsruhe/";
+	unsigned queryNumber = argc > 2 ? atoi(argv[2]) : 1000;
+
+	adjacencyGraph graph(graph_folder);
+	vector<unsigned> source = load_vector<unsigned>(graph_folder + "test/source");
+	vector<unsigned> target = load_vector<unsigned>(graph_folder + "test/target");
+	vector<unsigned> length = load_vector<unsigned>(graph_folder + "test/travel_time_length");
+	queryNumber = min<unsigned>(queryNumber, source.size());
+
+	cout << graph.vertexNumber() << " nodes, " << graph.edgeNumber() << " edges, " << queryNumber << " queries" << endl;
+	for (unsigned round = 0; round < 2; round++) {
+		benchmark<MinIDHeap<IDKeyPair, TimeCostProjection, 2> >("2-ary heap", graph, source, target, length, queryNumber);
+		benchmark<MinIDHeap<IDKeyPair, TimeCostProjection, 4> >("4-ary heap", graph, source, target, length, queryNumber);
+		benchmark<MinIDHeap<IDKeyPair, TimeCostProjection, 8> >("8-ary heap", graph, source, target, length, queryNumber);
+		benchmark<RadixIDQueue>("radix heap", graph, source, target, length, queryNumber);
+	}
+	return 0;
+}
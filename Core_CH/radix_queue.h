@@ -0,0 +1,177 @@
+#ifndef RADIX_QUEUE_H
+#define RADIX_QUEUE_H
+
+#include "constants.h"
+#include "id_queue.h"
+#include <vector>
+#include <cassert>
+
+//! A monotone priority queue with the interface of MinIDQueue, i.e., a radix heap over key.timeCost.
+//! Keys that are pushed or decreased must not be smaller than the key popped last, which holds for
+//! Dijkstra with non-negative weights. An element lies in bucket b if the highest bit in which its key
+//! differs from the last popped key is bit b-1; bucket 0 holds the keys equal to it. Elements only ever
+//! move to lower buckets, so pop does O(log C) amortized work and compares no keys outside of one bucket.
+class RadixIDQueue{
+private:
+	static const unsigned bucket_count = 33;
+public:
+	RadixIDQueue():heap_size(0), last_key(0){}
+
+	explicit RadixIDQueue(unsigned id_count):
+		id_bucket(id_count),
+		id_pos(id_count, invalid_id),
+		heap_size(0),
+		last_key(0){}
+
+	//! Returns whether the queue is empty. Equivalent to checking whether size() returns 0.
+	bool empty()const{
+		return heap_size == 0;
+	}
+
+	//! Returns the number of elements in the queue.
+	unsigned size()const{
+		return heap_size;
+	}
+
+	//! Returns the id_count value passed to the constructor.
+	unsigned id_count()const{
+		return id_pos.size();
+	}
+
+	//! Checks whether an element is in the queue.
+	bool contains_id(unsigned id)const{
+		assert(id < id_count());
+		return id_pos[id] != invalid_id;
+	}
+
+	//! Removes all elements from the queue. Afterwards any key can be pushed again.
+	void clear(){
+		for(unsigned b=0; b<bucket_count; ++b){
+			for(unsigned i=0; i<bucket[b].size(); ++i)
+				id_pos[bucket[b][i].id] = invalid_id;
+			bucket[b].clear();
+		}
+		heap_size = 0;
+		last_key = 0;
+	}
+
+	friend void swap(RadixIDQueue&l, RadixIDQueue&r){
+		using std::swap;
+		swap(l.id_bucket, r.id_bucket);
+		swap(l.id_pos, r.id_pos);
+		for(unsigned b=0; b<bucket_count; ++b)
+			swap(l.bucket[b], r.bucket[b]);
+		swap(l.heap_size, r.heap_size);
+		swap(l.last_key, r.last_key);
+	}
+
+	//! Returns the current key of an element.
+	//! Undefined if the element is not part of the queue.
+	edgeCost get_key(unsigned id)const{
+		assert(id < id_count());
+		assert(id_pos[id] != invalid_id);
+		return bucket[id_bucket[id]][id_pos[id]].key;
+	}
+
+	//! Returns the smallest element key pair without removing it from the queue.
+	//! Not const, because it may have to redistribute a bucket first.
+	IDKeyPair peek(){
+		assert(!empty());
+		refill();
+		return bucket[0].back();
+	}
+
+	//! Returns the smallest element key pair and removes it form the queue.
+	IDKeyPair pop(){
+		assert(!empty());
+		refill();
+		IDKeyPair p = bucket[0].back();
+		bucket[0].pop_back();
+		id_pos[p.id] = invalid_id;
+		--heap_size;
+		return p;
+	}
+
+	//! Inserts a element key pair.
+	//! Undefined if the element is part of the queue or the key is smaller than the last popped key.
+	void push(IDKeyPair p){
+		assert(p.id < id_count());
+		assert(!contains_id(p.id));
+		assert(p.key.timeCost >= last_key);
+		insert(p);
+		++heap_size;
+	}
+
+	//! Updates the key of an element if the new key is smaller than the old key.
+	//! Does nothing if the new key is larger.
+	//! Undefined if the element is not part of the queue or the key is smaller than the last popped key.
+	bool decrease_key(IDKeyPair p){
+		assert(p.id < id_count());
+		assert(contains_id(p.id));
+		assert(p.key.timeCost >= last_key);
+
+		unsigned b = id_bucket[p.id];
+		unsigned pos = id_pos[p.id];
+		if(bucket[b][pos].key.timeCost > p.key.timeCost){
+			erase(b, pos);
+			insert(p);
+			return true;
+		} else {
+			return false;
+		}
+	}
+
+private:
+	unsigned bucket_of(unsigned key)const{
+		return key == last_key ? 0 : 32 - __builtin_clz(key ^ last_key);
+	}
+
+	void insert(IDKeyPair p){
+		unsigned b = bucket_of(p.key.timeCost);
+		id_bucket[p.id] = b;
+		id_pos[p.id] = bucket[b].size();
+		bucket[b].push_back(p);
+	}
+
+	void erase(unsigned b, unsigned pos){
+		if(pos+1 != bucket[b].size()){
+			bucket[b][pos] = bucket[b].back();
+			id_pos[bucket[b][pos].id] = pos;
+		}
+		bucket[b].pop_back();
+	}
+
+	//! Makes bucket 0 non-empty: the smallest key of the first non-empty bucket becomes the last key
+	//! and the elements of that bucket are distributed to the buckets below it.
+	void refill(){
+		if(!bucket[0].empty())
+			return;
+		unsigned b = 1;
+		while(bucket[b].empty())
+			++b;
+		unsigned min_key = bucket[b][0].key.timeCost;
+		for(unsigned i=1; i<bucket[b].size(); ++i)
+			min_key = std::min(min_key, bucket[b][i].key.timeCost);
+		last_key = min_key;
+		for(unsigned i=0; i<bucket[b].size(); ++i)
+			insert(bucket[b][i]);
+		bucket[b].clear();
+	}
+
+	std::vector<unsigned char>id_bucket;
+	std::vector<unsigned>id_pos;
+	std::vector<IDKeyPair>bucket[bucket_count];
+
+	unsigned heap_size;
+	unsigned last_key;
+};
+
+//! The queue of the Dijkstra searches in WitnessSearch, QueryContext and ManyToManyQuery.
+//! Compile with -DCORE_CH_RADIX_QUEUE to use the radix heap instead of the 4-ary heap.
+#ifdef CORE_CH_RADIX_QUEUE
+typedef RadixIDQueue DijkstraQueue;
+#else
+typedef MinIDQueue DijkstraQueue;
+#endif
+
+#endif
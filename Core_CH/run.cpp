@@ -1,19 +1,20 @@
 // reference.cpp : Defines the entry point for the console application.
 
 #include "CHQuery.h"
+#include "CoreCHQuery.h"
+#include "CHFile.h"
 #include "ContractionBuilder.h"
 #include "Graph.h"
 #include "vector_io.h"
 #include "timer.h"
 #include <string>
 #include <iostream>
+#include <fstream>
 using namespace std;
 
 
 void coreCH(const string graph_folder) {
 
-//	string test_folder = graph_folder + "test/";
-
 	std::cout<<"Loading graph"<<std::endl;
 /*
 	vector<unsigned> first_out={0,3,6,9,12,15,16,17,17,17};
@@ -41,18 +42,29 @@ void coreCH(const string graph_folder) {
 	} 
 	std::cout<<"Setting up Builder"<<std::endl;
 	ContractionBuilder builder(graph,chargingStation);
+	//the index is also read by ParetoQuery and EVQuery, which need the time/energy trade-offs between core nodes
+	builder.setEnergyAwareWitnesses(true);
 	long long contractionBegin = get_micro_time();
 	cout<<"Core size (min. 1):"<<endl;
 	unsigned size = 1;
 	cin>>size;
 	cout<<endl;
+	cout<<"Threads (0 for all cores, 1 for sequential contraction):"<<endl;
+	unsigned threads = 1;
+	cin>>threads;
+	cout<<endl;
 	
-	builder.run(size);
+	if(threads == 1)
+		builder.run(size);
+	else
+		builder.runParallel(size, threads);
 	
 	std::cout<<"Contraction finished"<<std::endl;														//input value is the size of the core
 	long long contractionEnd = get_micro_time();
 	
 	cout<< "Contraction Time: "<< contractionEnd - contractionBegin<<endl;
+	ofstream telemetry(graph_folder + "contraction_telemetry.json");
+	builder.getTelemetry().writeJSON(telemetry);
 	//runǿͼwichtigkeit
 
 	adjacencyGraph aug = builder.getAugmentedGraph();
@@ -68,8 +80,10 @@ void coreCH(const string graph_folder) {
 	}
 
 //	save_vector("graph/stupferich/CH_Core/order",order);
+	saveCHFile(graph_folder + "core_ch_index", aug, order, builder.getCoreSize(), chargingStation, builder.hasEnergyAwareWitnesses());
+	cout<<"Index written to "<<graph_folder<<"core_ch_index"<<endl;
 	
-	CHQuery ch_time(aug, order);
+	CoreCHQuery ch_time(aug, order, builder.getCoreSize());
 	cout<<"Edge Number after contraction:		"<<aug.getHead().size()<<endl;
 //	cout<<aug.getHead().size()<<endl;
 	vector<unsigned> ori = load_vector<unsigned>("../../graph/karlsruhe/head");
@@ -92,29 +106,7 @@ void coreCH(const string graph_folder) {
 	
 //	cout<<"Original edges:				 "<<ori.size()<<endl;
 	//ͨǿͼwichtigkeitѯ·
-/*
-	vector<unsigned> source = load_vector<unsigned>(test_folder + "source");
-	vector<unsigned> target = load_vector<unsigned>(test_folder + "target");
-	vector<unsigned> travel_time_length = load_vector<unsigned>(test_folder + "travel_time_length");
-
-	vector<edgeCost>	queryResult(source.size());
-	vector<unsigned> queryResultTime(source.size());
-	save_vector("graph/stupferich/CH_Core/queryResult",queryResult);
-	save_vector("graph/stupferich/CH_Core/queryResultTime",queryResultTime);
-	
-long long queryBegin = get_micro_time();
-    unsigned queryTimes = source.size() / 1000;
-	for (unsigned i = 0; i < queryTimes; i++) {
-		edgeCost pathCost = ch_time.run(source[i], target[i]);
-		unsigned time = pathCost.timeCost;
-		queryResult[i] = pathCost;
-		queryResultTime[i] = time;
-	}
-	
-long long queryEnd = get_micro_time();
-
-	cout<<"Query time: "<< queryEnd - queryBegin<<" (for "<<queryTimes<<" queries)"<<endl;
-	*/
+	//the test queries are checked and timed by queryBenchmark.cpp
 }
 
 
@@ -1,4 +1,4 @@
 #!/bin/sh
 
-g++ run.cpp -o Test -std=c++11
+g++ run.cpp -o Test -std=c++11 -pthread
 
@@ -5,6 +5,9 @@
 #include <vector>
 #include <stdexcept>
 #include <fstream>
+#include <memory>
+#include <cassert>
+#include "mapped_file.h"
 
 template<class T>
 void save_vector(const std::string&file_name, const std::vector<T>&vec){
@@ -29,4 +32,106 @@ std::vector<T>load_vector(const std::string&file_name){
 	return vec; // NVRO
 }
 
+//! A read-only array that is usually a mapping of a file written by save_vector.
+//! It offers the const interface of std::vector, so graphs can hold it instead of a loaded vector
+//! and nothing is copied into anonymous memory. Writing to it, e.g., through the non-const
+//! operator[] or resize, first copies the elements into an owned vector.
+template<class T>
+class mapped_vector{
+public:
+	typedef T value_type;
+	typedef const T*const_iterator;
+
+	mapped_vector():begin_(0), size_(0){}
+
+	explicit mapped_vector(std::size_t n, const T&value = T()):
+		owned(n, value){ point_to_owned(); }
+
+	mapped_vector(std::vector<T>vec):
+		owned(std::move(vec)){ point_to_owned(); }
+
+	mapped_vector(std::shared_ptr<const MappedFile>file, const T*begin, std::size_t size):
+		file(std::move(file)), begin_(begin), size_(size){}
+
+	mapped_vector(const mapped_vector&other):
+		owned(other.owned), file(other.file), begin_(other.begin_), size_(other.size_){
+		if(!file)
+			point_to_owned();
+	}
+
+	mapped_vector(mapped_vector&&other):mapped_vector(){
+		swap(*this, other);
+	}
+
+	mapped_vector&operator=(mapped_vector other){
+		swap(*this, other);
+		return *this;
+	}
+
+	friend void swap(mapped_vector&l, mapped_vector&r){
+		using std::swap;
+		swap(l.owned, r.owned);
+		swap(l.file, r.file);
+		swap(l.begin_, r.begin_);
+		swap(l.size_, r.size_);
+	}
+
+	//! Returns whether the elements are still read from the mapped file.
+	bool is_mapped()const{ return file != nullptr; }
+
+	std::size_t size()const{ return size_; }
+	bool empty()const{ return size_ == 0; }
+	const T*data()const{ return begin_; }
+	const T&operator[](std::size_t i)const{ assert(i < size_); return begin_[i]; }
+	const_iterator begin()const{ return begin_; }
+	const_iterator end()const{ return begin_ + size_; }
+
+	T&operator[](std::size_t i){ assert(i < size_); make_writable(); return owned[i]; }
+	T*data(){ make_writable(); return owned.data(); }
+
+	void resize(std::size_t n){
+		make_writable();
+		owned.resize(n);
+		point_to_owned();
+	}
+
+	operator std::vector<T>()const{ return std::vector<T>(begin(), end()); }
+
+private:
+	void point_to_owned(){
+		begin_ = owned.data();
+		size_ = owned.size();
+	}
+
+	void make_writable(){
+		if(file){
+			owned.assign(begin(), end());
+			file.reset();
+			point_to_owned();
+		}
+	}
+
+	std::vector<T>owned;
+	std::shared_ptr<const MappedFile>file;
+	const T*begin_;
+	std::size_t size_;
+};
+
+//! Like load_vector but maps the file instead of reading it. hints are the map_* flags of mapped_file.h.
+//! Falls back to load_vector if the file can not be mapped.
+template<class T>
+mapped_vector<T>load_mapped_vector(const std::string&file_name, unsigned hints = 0){
+	std::shared_ptr<const MappedFile>file;
+	try{
+		file = std::make_shared<MappedFile>(file_name, hints);
+	}catch(std::exception&){
+		return mapped_vector<T>(load_vector<T>(file_name));
+	}
+	if(file->size() % sizeof(T) != 0)
+		throw std::runtime_error("File \""+file_name+"\" can not be a vector of the requested type because it's size is no multiple of the element type's size.");
+	const T*begin = reinterpret_cast<const T*>(file->data());
+	std::size_t size = file->size() / sizeof(T);
+	return mapped_vector<T>(std::move(file), begin, size);
+}
+
 #endif